@@ -0,0 +1,190 @@
+#include "TerrainNoise.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#if defined(NOISE_HAS_AVX2) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+
+#if defined(NOISE_HAS_AVX2)
+// TerrainNoiseAvx2.cpp, fills the row in groups of 8 texels and returns how many it filled
+std::uint32_t terrain_noise_row_avx2(
+  float* row,
+  std::uint32_t y,
+  std::uint32_t width,
+  std::uint32_t height,
+  std::uint32_t octaves,
+  float amplitude,
+  float frequency_multiplier,
+  float scale);
+#endif
+
+namespace
+{
+
+// Same constants as hash22 in terrain_noise.glsl
+constexpr std::uint32_t HASH_MULTIPLIER = 1664525u;
+constexpr std::uint32_t HASH_INCREMENT = 1013904223u;
+
+// Rows a thread takes at once when baking
+constexpr std::uint32_t BAKE_ROWS_PER_TASK = 16;
+
+// Gradient in [-1, 1) of a lattice cell. The top 24 bits convert to float exactly
+void hash22(std::int32_t cell_x, std::int32_t cell_y, float& gradient_x, float& gradient_y)
+{
+  std::uint32_t x = static_cast<std::uint32_t>(cell_x) * HASH_MULTIPLIER + HASH_INCREMENT;
+  std::uint32_t y = static_cast<std::uint32_t>(cell_y) * HASH_MULTIPLIER + HASH_INCREMENT;
+  x += y * HASH_MULTIPLIER;
+  y += x * HASH_MULTIPLIER;
+  x ^= x >> 16u;
+  y ^= y >> 16u;
+  x += y * HASH_MULTIPLIER;
+  y += x * HASH_MULTIPLIER;
+  x ^= x >> 16u;
+  y ^= y >> 16u;
+  gradient_x = static_cast<float>(x >> 8u) * (2.0f / 16777216.0f) - 1.0f;
+  gradient_y = static_cast<float>(y >> 8u) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+float quintic(float t)
+{
+  return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// Same operation order as GLSL mix
+float mix(float x, float y, float a)
+{
+  return x * (1.0f - a) + y * a;
+}
+
+bool detect_avx2()
+{
+#if !defined(NOISE_HAS_AVX2)
+  return false;
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  // The OS has to save the AVX registers too
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  if (!osxsave || (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+void bake_row(float* row, std::uint32_t y, std::uint32_t width, std::uint32_t height, const TerrainNoiseParams& params)
+{
+  std::uint32_t x = 0;
+#if defined(NOISE_HAS_AVX2)
+  if (terrain_noise_uses_avx2())
+    x = terrain_noise_row_avx2(
+      row, y, width, height, params.octaves, params.amplitude, params.frequencyMultiplier, params.scale);
+#endif
+
+  const float stY = static_cast<float>(y) / static_cast<float>(height);
+  for (; x < width; ++x)
+    row[x] = terrain_height({static_cast<float>(x) / static_cast<float>(width), stY}, params);
+}
+
+} // namespace
+
+float gradient_noise(glm::vec2 p)
+{
+  const float floorX = std::floor(p.x);
+  const float floorY = std::floor(p.y);
+  const float fx = p.x - floorX;
+  const float fy = p.y - floorY;
+  const auto cellX = static_cast<std::int32_t>(floorX);
+  const auto cellY = static_cast<std::int32_t>(floorY);
+
+  float g00x, g00y, g10x, g10y, g01x, g01y, g11x, g11y;
+  hash22(cellX, cellY, g00x, g00y);
+  hash22(cellX + 1, cellY, g10x, g10y);
+  hash22(cellX, cellY + 1, g01x, g01y);
+  hash22(cellX + 1, cellY + 1, g11x, g11y);
+
+  const float n00 = g00x * fx + g00y * fy;
+  const float n10 = g10x * (fx - 1.0f) + g10y * fy;
+  const float n01 = g01x * fx + g01y * (fy - 1.0f);
+  const float n11 = g11x * (fx - 1.0f) + g11y * (fy - 1.0f);
+
+  const float ux = quintic(fx);
+  const float uy = quintic(fy);
+
+  return mix(mix(n00, n10, ux), mix(n01, n11, ux), uy);
+}
+
+float fbm(glm::vec2 p, std::uint32_t octaves, float amplitude, float frequency_multiplier)
+{
+  float value = 0.0f;
+  float frequency = 1.0f;
+  float maxValue = 0.0f;
+
+  for (std::uint32_t i = 0; i < octaves; ++i)
+  {
+    value += amplitude * gradient_noise({p.x * frequency, p.y * frequency});
+    maxValue += amplitude;
+    amplitude *= 0.5f;
+    frequency *= frequency_multiplier;
+  }
+
+  return value / maxValue;
+}
+
+float terrain_height(glm::vec2 st, const TerrainNoiseParams& params)
+{
+  const glm::vec2 p{st.x * params.scale, st.y * params.scale};
+  const float noise = fbm(p, params.octaves, params.amplitude, params.frequencyMultiplier) * 0.5f + 0.5f;
+  return noise + 0.5f;
+}
+
+void bake_terrain_heights(
+  std::span<float> heights,
+  std::uint32_t width,
+  std::uint32_t height,
+  const TerrainNoiseParams& params,
+  std::uint32_t thread_count)
+{
+  assert(heights.size() >= static_cast<std::size_t>(width) * height);
+
+  if (thread_count == 0)
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  thread_count = std::min(thread_count, (height + BAKE_ROWS_PER_TASK - 1) / BAKE_ROWS_PER_TASK);
+
+  std::atomic<std::uint32_t> nextRow{0};
+  auto worker = [&]() {
+    for (;;)
+    {
+      const std::uint32_t firstRow = nextRow.fetch_add(BAKE_ROWS_PER_TASK);
+      if (firstRow >= height)
+        return;
+      const std::uint32_t lastRow = std::min(height, firstRow + BAKE_ROWS_PER_TASK);
+      for (std::uint32_t y = firstRow; y < lastRow; ++y)
+        bake_row(heights.data() + static_cast<std::size_t>(y) * width, y, width, height, params);
+    }
+  };
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(thread_count);
+    for (std::uint32_t i = 1; i < thread_count; ++i)
+      threads.emplace_back(worker);
+    worker();
+  }
+}
+
+bool terrain_noise_uses_avx2()
+{
+  static const bool supported = detect_avx2();
+  return supported;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include <glm/glm.hpp>
+
+
+/**
+ * CPU version of the terrain noise in terrain_noise.glsl: integer lattice hash,
+ * quintic gradient noise and fBm. The hash is integer only and the rest is plain
+ * IEEE float math without fused multiply-adds, so the lattice gradients match the
+ * GPU exactly and heights differ by the few ULP Vulkan allows for division and
+ * contraction. The AVX2 path evaluates 8 texels at once and gives the same bits
+ * as the scalar one.
+ */
+struct TerrainNoiseParams
+{
+  std::uint32_t octaves = 10;
+  float amplitude = 0.5f;
+  float frequencyMultiplier = 2.0f;
+  float scale = 8.0f;
+};
+
+float gradient_noise(glm::vec2 p);
+float fbm(glm::vec2 p, std::uint32_t octaves, float amplitude, float frequency_multiplier);
+
+// Height before encoding, st is terrain space divided by the terrain size
+float terrain_height(glm::vec2 st, const TerrainNoiseParams& params);
+
+// Heights of a width x height grid sampled at st = texel / size like the GPU heightmap, row-major.
+// Rows are spread over thread_count threads, zero picks the hardware concurrency
+void bake_terrain_heights(
+  std::span<float> heights,
+  std::uint32_t width,
+  std::uint32_t height,
+  const TerrainNoiseParams& params,
+  std::uint32_t thread_count = 0);
+
+// Whether this CPU takes the 8-wide AVX2 path
+bool terrain_noise_uses_avx2();
@@ -0,0 +1,135 @@
+// NOTE: compiled with AVX2 enabled, so it stays away from glm and the standard library:
+// inline functions instantiated here could replace the baseline ones at link time
+
+#include <cstdint>
+
+#include <immintrin.h>
+
+
+namespace
+{
+
+// Same constants as hash22 in terrain_noise.glsl
+constexpr std::uint32_t HASH_MULTIPLIER = 1664525u;
+constexpr std::uint32_t HASH_INCREMENT = 1013904223u;
+
+__m256 hash_to_gradient(__m256i hash)
+{
+  const __m256 top = _mm256_cvtepi32_ps(_mm256_srli_epi32(hash, 8));
+  return _mm256_sub_ps(_mm256_mul_ps(top, _mm256_set1_ps(2.0f / 16777216.0f)), _mm256_set1_ps(1.0f));
+}
+
+void hash22(__m256i cell_x, __m256i cell_y, __m256& gradient_x, __m256& gradient_y)
+{
+  const __m256i multiplier = _mm256_set1_epi32(static_cast<int>(HASH_MULTIPLIER));
+  const __m256i increment = _mm256_set1_epi32(static_cast<int>(HASH_INCREMENT));
+
+  __m256i x = _mm256_add_epi32(_mm256_mullo_epi32(cell_x, multiplier), increment);
+  __m256i y = _mm256_add_epi32(_mm256_mullo_epi32(cell_y, multiplier), increment);
+  x = _mm256_add_epi32(x, _mm256_mullo_epi32(y, multiplier));
+  y = _mm256_add_epi32(y, _mm256_mullo_epi32(x, multiplier));
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+  y = _mm256_xor_si256(y, _mm256_srli_epi32(y, 16));
+  x = _mm256_add_epi32(x, _mm256_mullo_epi32(y, multiplier));
+  y = _mm256_add_epi32(y, _mm256_mullo_epi32(x, multiplier));
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+  y = _mm256_xor_si256(y, _mm256_srli_epi32(y, 16));
+
+  gradient_x = hash_to_gradient(x);
+  gradient_y = hash_to_gradient(y);
+}
+
+__m256 dot(__m256 gradient_x, __m256 gradient_y, __m256 x, __m256 y)
+{
+  return _mm256_add_ps(_mm256_mul_ps(gradient_x, x), _mm256_mul_ps(gradient_y, y));
+}
+
+__m256 quintic(__m256 t)
+{
+  const __m256 inner = _mm256_add_ps(
+    _mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))),
+    _mm256_set1_ps(10.0f));
+  return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+__m256 mix(__m256 x, __m256 y, __m256 a)
+{
+  return _mm256_add_ps(_mm256_mul_ps(x, _mm256_sub_ps(_mm256_set1_ps(1.0f), a)), _mm256_mul_ps(y, a));
+}
+
+// Mirrors gradient_noise in TerrainNoise.cpp operation by operation
+__m256 gradient_noise(__m256 px, __m256 py)
+{
+  const __m256 floorX = _mm256_floor_ps(px);
+  const __m256 floorY = _mm256_floor_ps(py);
+  const __m256 fx = _mm256_sub_ps(px, floorX);
+  const __m256 fy = _mm256_sub_ps(py, floorY);
+  const __m256i cellX = _mm256_cvttps_epi32(floorX);
+  const __m256i cellY = _mm256_cvttps_epi32(floorY);
+  const __m256i one = _mm256_set1_epi32(1);
+
+  __m256 g00x, g00y, g10x, g10y, g01x, g01y, g11x, g11y;
+  hash22(cellX, cellY, g00x, g00y);
+  hash22(_mm256_add_epi32(cellX, one), cellY, g10x, g10y);
+  hash22(cellX, _mm256_add_epi32(cellY, one), g01x, g01y);
+  hash22(_mm256_add_epi32(cellX, one), _mm256_add_epi32(cellY, one), g11x, g11y);
+
+  const __m256 fx1 = _mm256_sub_ps(fx, _mm256_set1_ps(1.0f));
+  const __m256 fy1 = _mm256_sub_ps(fy, _mm256_set1_ps(1.0f));
+  const __m256 n00 = dot(g00x, g00y, fx, fy);
+  const __m256 n10 = dot(g10x, g10y, fx1, fy);
+  const __m256 n01 = dot(g01x, g01y, fx, fy1);
+  const __m256 n11 = dot(g11x, g11y, fx1, fy1);
+
+  const __m256 ux = quintic(fx);
+  const __m256 uy = quintic(fy);
+
+  return mix(mix(n00, n10, ux), mix(n01, n11, ux), uy);
+}
+
+} // namespace
+
+std::uint32_t terrain_noise_row_avx2(
+  float* row,
+  std::uint32_t y,
+  std::uint32_t width,
+  std::uint32_t height,
+  std::uint32_t octaves,
+  float amplitude,
+  float frequency_multiplier,
+  float scale)
+{
+  const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+  const __m256 widthF = _mm256_set1_ps(static_cast<float>(width));
+  const __m256 scaleF = _mm256_set1_ps(scale);
+  const float stY = static_cast<float>(y) / static_cast<float>(height);
+  const __m256 py = _mm256_set1_ps(stY * scale);
+
+  const std::uint32_t filled = width & ~7u;
+  for (std::uint32_t x = 0; x < filled; x += 8)
+  {
+    // Texel indices stay far below 2^24, so they are exact in float like the scalar conversion
+    const __m256 texelX = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lane);
+    const __m256 px = _mm256_mul_ps(_mm256_div_ps(texelX, widthF), scaleF);
+
+    __m256 value = _mm256_setzero_ps();
+    float octaveAmplitude = amplitude;
+    float frequency = 1.0f;
+    float maxValue = 0.0f;
+    for (std::uint32_t i = 0; i < octaves; ++i)
+    {
+      const __m256 noise = gradient_noise(
+        _mm256_mul_ps(px, _mm256_set1_ps(frequency)), _mm256_mul_ps(py, _mm256_set1_ps(frequency)));
+      value = _mm256_add_ps(value, _mm256_mul_ps(_mm256_set1_ps(octaveAmplitude), noise));
+      maxValue += octaveAmplitude;
+      octaveAmplitude *= 0.5f;
+      frequency *= frequency_multiplier;
+    }
+
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 fbm = _mm256_div_ps(value, _mm256_set1_ps(maxValue));
+    const __m256 result = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fbm, half), half), half);
+    _mm256_storeu_ps(row + x, result);
+  }
+  return filled;
+}
@@ -0,0 +1,117 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "TerrainNoise.hpp"
+
+// Checks the CPU terrain noise without a GPU: the AVX2 bake against the scalar
+// path bit for bit, and heights against samples of terrain_generate.glsl.
+
+namespace
+{
+
+struct ReferenceSample
+{
+  std::int32_t texelX;
+  std::int32_t texelY;
+  std::uint32_t width;
+  std::uint32_t height;
+  TerrainNoiseParams params;
+  float expected;
+};
+
+// terrainHeight() of terrain_noise.glsl at st = vec2(texel) / vec2(size), as terrain_generate.glsl
+// samples it. Dumped by evaluating the shader source as C++ with IEEE float ops and no contraction;
+// regenerate them whenever terrain_noise.glsl changes
+constexpr ReferenceSample REFERENCE_SAMPLES[] = {
+  {37, 1001, 4096u, 4096u, {10u, 0x1p-1f, 0x1p+1f, 0x1p+3f}, 0x1.03f42p+0f},
+  {2047, 3, 4096u, 4096u, {10u, 0x1p-1f, 0x1p+1f, 0x1p+3f}, 0x1.008bc8p+0f},
+  {4095, 4095, 4096u, 4096u, {10u, 0x1p-1f, 0x1p+1f, 0x1p+3f}, 0x1.fec52cp-1f},
+  {-1, 700, 4096u, 4096u, {10u, 0x1p-1f, 0x1p+1f, 0x1p+3f}, 0x1.0ce914p+0f},
+  {123, 456, 1000u, 1000u, {10u, 0x1p-1f, 0x1p+1f, 0x1p+3f}, 0x1.fbbf46p-1f},
+  {999, 1, 1000u, 1000u, {10u, 0x1p-1f, 0x1p+1f, 0x1p+3f}, 0x1.00c696p+0f},
+  {1026, 514, 1027u, 515u, {10u, 0x1p-1f, 0x1p+1f, 0x1p+3f}, 0x1.f97144p-1f},
+  {37, 1001, 4096u, 4096u, {4u, 0x1.666666p-1f, 0x1.4p+1f, 0x1.8p+1f}, 0x1.d1f3b4p-1f},
+  {2047, 3, 4096u, 4096u, {4u, 0x1.666666p-1f, 0x1.4p+1f, 0x1.8p+1f}, 0x1.185ffcp+0f},
+  {4095, 4095, 4096u, 4096u, {4u, 0x1.666666p-1f, 0x1.4p+1f, 0x1.8p+1f}, 0x1.eb5292p-1f},
+  {-1, 700, 4096u, 4096u, {4u, 0x1.666666p-1f, 0x1.4p+1f, 0x1.8p+1f}, 0x1.c4ef2cp-1f},
+  {123, 456, 1000u, 1000u, {4u, 0x1.666666p-1f, 0x1.4p+1f, 0x1.8p+1f}, 0x1.18751ep+0f},
+  {999, 1, 1000u, 1000u, {4u, 0x1.666666p-1f, 0x1.4p+1f, 0x1.8p+1f}, 0x1.ff59ccp-1f},
+  {1026, 514, 1027u, 515u, {4u, 0x1.666666p-1f, 0x1.4p+1f, 0x1.8p+1f}, 0x1.ebed8p-1f},
+  {37, 1001, 4096u, 4096u, {1u, 0x1p+0f, 0x1p+1f, 0x1p+4f}, 0x1.f80a28p-1f},
+  {2047, 3, 4096u, 4096u, {1u, 0x1p+0f, 0x1p+1f, 0x1p+4f}, 0x1.00c828p+0f},
+  {4095, 4095, 4096u, 4096u, {1u, 0x1p+0f, 0x1p+1f, 0x1p+4f}, 0x1.fe91bp-1f},
+  {-1, 700, 4096u, 4096u, {1u, 0x1p+0f, 0x1p+1f, 0x1p+4f}, 0x1.1c3c96p+0f},
+  {123, 456, 1000u, 1000u, {1u, 0x1p+0f, 0x1p+1f, 0x1p+4f}, 0x1.095daep+0f},
+  {999, 1, 1000u, 1000u, {1u, 0x1p+0f, 0x1p+1f, 0x1p+4f}, 0x1.fc56ap-1f},
+  {1026, 514, 1027u, 515u, {1u, 0x1p+0f, 0x1p+1f, 0x1p+4f}, 0x1.f78bdcp-1f},
+};
+
+// GPUs may divide and contract with a few ULP of error per operation, fBm sums ten octaves of it
+constexpr float GPU_TOLERANCE = 1e-5f;
+
+int check_reference_samples()
+{
+  int failures = 0;
+  for (const auto& sample : REFERENCE_SAMPLES)
+  {
+    const glm::vec2 st{
+      static_cast<float>(sample.texelX) / static_cast<float>(sample.width),
+      static_cast<float>(sample.texelY) / static_cast<float>(sample.height)};
+    const float height = terrain_height(st, sample.params);
+    if (!(std::abs(height - sample.expected) <= GPU_TOLERANCE))
+    {
+      std::printf(
+        "reference mismatch at texel (%d, %d) of %ux%u, %u octaves: %.9g, expected %.9g\n",
+        sample.texelX, sample.texelY, sample.width, sample.height, sample.params.octaves,
+        height, sample.expected);
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+// The bake takes the AVX2 path where available, terrain_height() is always scalar.
+// The width leaves a ragged tail after the groups of 8 texels
+int check_bake_matches_scalar()
+{
+  constexpr std::uint32_t width = 1027;
+  constexpr std::uint32_t height = 37;
+  const TerrainNoiseParams params{};
+
+  std::vector<float> baked(width * height);
+  bake_terrain_heights(baked, width, height, params, 4);
+
+  int failures = 0;
+  for (std::uint32_t y = 0; y < height; ++y)
+    for (std::uint32_t x = 0; x < width; ++x)
+    {
+      const float expected = terrain_height(
+        {static_cast<float>(x) / static_cast<float>(width), static_cast<float>(y) / static_cast<float>(height)},
+        params);
+      const float actual = baked[y * width + x];
+      // Bit for bit, a NaN would also fail here
+      if (std::memcmp(&expected, &actual, sizeof(float)) != 0)
+      {
+        if (failures < 10)
+          std::printf("bake mismatch at (%u, %u): %.9g, scalar %.9g\n", x, y, actual, expected);
+        ++failures;
+      }
+    }
+  return failures;
+}
+
+} // namespace
+
+int main()
+{
+  std::printf("AVX2 path %s\n", terrain_noise_uses_avx2() ? "enabled" : "not available, bake is scalar too");
+
+  const int referenceFailures = check_reference_samples();
+  const int bakeFailures = check_bake_matches_scalar();
+
+  std::printf("reference samples: %d failed, bake: %d texels differ\n", referenceFailures, bakeFailures);
+  return referenceFailures == 0 && bakeFailures == 0 ? 0 : 1;
+}
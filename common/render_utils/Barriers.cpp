@@ -0,0 +1,32 @@
+#include "Barriers.hpp"
+
+
+void memory_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+  };
+  vk::DependencyInfo depInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  };
+  cmd_buf.pipelineBarrier2(&depInfo);
+}
+
+void compute_barrier(vk::CommandBuffer cmd_buf)
+{
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite);
+}
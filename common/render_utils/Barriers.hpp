@@ -0,0 +1,15 @@
+#pragma once
+
+#include <etna/Vulkan.hpp>
+
+
+// Global memory dependency between two synchronization scopes of the same queue
+void memory_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access);
+
+// Makes compute shader writes visible to the next dispatches
+void compute_barrier(vk::CommandBuffer cmd_buf);
@@ -0,0 +1,15 @@
+#include "Frustum.hpp"
+
+
+void extract_frustum_planes(const glm::mat4& view_proj, glm::vec4 (&planes)[6])
+{
+  const glm::mat4 m = glm::transpose(view_proj);
+  planes[0] = m[3] + m[0]; // left
+  planes[1] = m[3] - m[0]; // right
+  planes[2] = m[3] + m[1]; // bottom
+  planes[3] = m[3] - m[1]; // top
+  planes[4] = m[3] + m[2]; // near
+  planes[5] = m[3] - m[2]; // far
+  for (auto& plane : planes)
+    plane /= glm::length(glm::vec3(plane));
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+
+// Gribb-Hartmann extraction of left, right, bottom, top, near and far planes,
+// normalized and pointing inside the frustum. The near plane is the one of a
+// [-1, 1] depth range, which is also conservative for [0, 1] projections
+void extract_frustum_planes(const glm::mat4& view_proj, glm::vec4 (&planes)[6]);
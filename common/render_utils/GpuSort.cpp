@@ -0,0 +1,96 @@
+#include "GpuSort.hpp"
+
+#include <bit>
+
+#include <etna/Assert.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/DescriptorSet.hpp>
+
+#include "Barriers.hpp"
+#include "shaders/gpu_sort.h"
+
+
+static_assert(GpuSort::LOCAL_SORT_SIZE == GPU_SORT_LOCAL_SIZE);
+
+GpuSort::GpuSort()
+{
+  localProgramId = etna::get_program_id("gpu_sort_local");
+  if (localProgramId == etna::ShaderProgramId::Invalid)
+    localProgramId = etna::create_program("gpu_sort_local", {RENDER_UTILS_SHADERS_ROOT "gpu_sort_local.comp.spv"});
+
+  globalProgramId = etna::get_program_id("gpu_sort_global");
+  if (globalProgramId == etna::ShaderProgramId::Invalid)
+    globalProgramId = etna::create_program("gpu_sort_global", {RENDER_UTILS_SHADERS_ROOT "gpu_sort_global.comp.spv"});
+
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  localPipeline = pipelineManager.createComputePipeline("gpu_sort_local", {});
+  globalPipeline = pipelineManager.createComputePipeline("gpu_sort_global", {});
+}
+
+void GpuSort::sort(vk::CommandBuffer cmd_buf, const etna::Buffer& pairs, std::uint32_t count)
+{
+  if (count <= 1)
+    return;
+
+  ETNA_VERIFYF(std::has_single_bit(count), "GpuSort: count {} is not a power of two", count);
+
+  auto localInfo = etna::get_shader_program(localProgramId);
+  auto localSet = etna::create_descriptor_set(
+    localInfo.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{0, pairs.genBinding()}});
+
+  auto globalInfo = etna::get_shader_program(globalProgramId);
+  auto globalSet = etna::create_descriptor_set(
+    globalInfo.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{0, pairs.genBinding()}});
+
+  struct LocalPushConstants
+  {
+    std::uint32_t count;
+    std::uint32_t blockSize;
+  };
+
+  struct GlobalPushConstants
+  {
+    std::uint32_t count;
+    std::uint32_t blockSize;
+    std::uint32_t compareDistance;
+  };
+
+  const std::uint32_t localGroups = (count + LOCAL_SORT_SIZE - 1) / LOCAL_SORT_SIZE;
+  // Every global invocation handles one compare-exchange pair
+  const std::uint32_t globalGroups = (count / 2 + GPU_SORT_THREADS - 1) / GPU_SORT_THREADS;
+
+  auto localPass = [&](std::uint32_t block_size) {
+    const LocalPushConstants pushConstants{count, block_size};
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, localPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, localPipeline.getVkPipelineLayout(), 0, {localSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      localPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+    cmd_buf.dispatch(localGroups, 1, 1);
+    compute_barrier(cmd_buf);
+  };
+
+  // Block size 0 sorts every block completely
+  localPass(0);
+
+  for (std::uint32_t blockSize = 2 * LOCAL_SORT_SIZE; blockSize <= count; blockSize <<= 1)
+  {
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, globalPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, globalPipeline.getVkPipelineLayout(), 0, {globalSet.getVkSet()}, {});
+
+    for (std::uint32_t compareDistance = blockSize >> 1; compareDistance >= LOCAL_SORT_SIZE; compareDistance >>= 1)
+    {
+      const GlobalPushConstants pushConstants{count, blockSize, compareDistance};
+      cmd_buf.pushConstants(
+        globalPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+      cmd_buf.dispatch(globalGroups, 1, 1);
+      compute_barrier(cmd_buf);
+    }
+
+    // The rest of the merge fits into a single block
+    localPass(blockSize);
+  }
+}
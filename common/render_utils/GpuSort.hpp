@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+
+
+/**
+ * Sorts (key, value) uvec2 pairs by key in ascending order on the GPU.
+ * Blocks of LOCAL_SORT_SIZE pairs are bitonic-sorted in shared memory,
+ * only merge stages with larger strides go through global memory, and each
+ * merge is finished in shared memory again. Sort keys together with an index
+ * and gather the payload afterwards instead of sorting the payload itself.
+ */
+class GpuSort
+{
+public:
+  static constexpr std::uint32_t LOCAL_SORT_SIZE = 2048;
+
+  GpuSort();
+  ~GpuSort() {}
+
+  // count must be a power of two. Records compute barriers between the passes,
+  // a barrier for whatever consumes the sorted pairs is up to the caller.
+  void sort(vk::CommandBuffer cmd_buf, const etna::Buffer& pairs, std::uint32_t count);
+
+private:
+  etna::ComputePipeline localPipeline;
+  etna::ComputePipeline globalPipeline;
+  etna::ShaderProgramId localProgramId;
+  etna::ShaderProgramId globalProgramId;
+
+  GpuSort(const GpuSort&) = delete;
+  GpuSort& operator=(const GpuSort&) = delete;
+};
@@ -0,0 +1,73 @@
+#include "GpuTimer.hpp"
+
+#include <array>
+
+#include <etna/GlobalContext.hpp>
+
+
+GpuTimer::GpuTimer(std::uint32_t scope_count, std::uint32_t frames_in_flight)
+  : scopeCount{scope_count}
+  , framesInFlight{frames_in_flight}
+  , written(frames_in_flight, std::vector<bool>(scope_count, false))
+  , lastMilliseconds(scope_count, 0.0f)
+{
+  auto& ctx = etna::get_context();
+  device = ctx.getDevice();
+  timestampPeriod = ctx.getPhysicalDevice().getProperties().limits.timestampPeriod;
+
+  queryPool = etna::unwrap_vk_result(device.createQueryPool(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = 2 * scopeCount * framesInFlight,
+  }));
+}
+
+GpuTimer::~GpuTimer()
+{
+  device.destroyQueryPool(queryPool);
+}
+
+std::uint32_t GpuTimer::queryIndex(std::uint32_t scope, bool stop) const
+{
+  return 2 * (frame * scopeCount + scope) + (stop ? 1 : 0);
+}
+
+void GpuTimer::beginFrame(vk::CommandBuffer cmd_buf)
+{
+  frame = (frame + 1) % framesInFlight;
+
+  // The command buffer that wrote these queries has finished by the time this frame slot is reused,
+  // queries which were never written are skipped, so the pool needs no reset on the host
+  for (std::uint32_t scope = 0; scope < scopeCount; ++scope)
+  {
+    if (!written[frame][scope])
+      continue;
+
+    std::array<std::uint64_t, 4> results{}; // two timestamps, each followed by availability
+    const auto result = device.getQueryPoolResults(
+      queryPool,
+      queryIndex(scope, false),
+      2,
+      sizeof(results),
+      results.data(),
+      2 * sizeof(std::uint64_t),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+
+    if ((result == vk::Result::eSuccess || result == vk::Result::eNotReady) && results[1] != 0 && results[3] != 0)
+      lastMilliseconds[scope] = float(results[2] - results[0]) * timestampPeriod * 1e-6f;
+
+    written[frame][scope] = false;
+  }
+
+  cmd_buf.resetQueryPool(queryPool, 2 * frame * scopeCount, 2 * scopeCount);
+}
+
+void GpuTimer::start(vk::CommandBuffer cmd_buf, std::uint32_t scope)
+{
+  cmd_buf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool, queryIndex(scope, false));
+}
+
+void GpuTimer::stop(vk::CommandBuffer cmd_buf, std::uint32_t scope)
+{
+  cmd_buf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, queryPool, queryIndex(scope, true));
+  written[frame][scope] = true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Measures GPU time between pairs of timestamps for a fixed number of scopes.
+ * Every frame in flight has its own range of queries, results are picked up
+ * when that frame comes around again, so reading them never stalls.
+ */
+class GpuTimer
+{
+public:
+  GpuTimer(std::uint32_t scope_count, std::uint32_t frames_in_flight);
+  ~GpuTimer();
+
+  // Collects the results recorded frames_in_flight frames ago and resets their queries,
+  // must be recorded outside of rendering
+  void beginFrame(vk::CommandBuffer cmd_buf);
+
+  void start(vk::CommandBuffer cmd_buf, std::uint32_t scope);
+  void stop(vk::CommandBuffer cmd_buf, std::uint32_t scope);
+
+  // Last measured duration of the scope, zero if it was never measured
+  float milliseconds(std::uint32_t scope) const { return lastMilliseconds[scope]; }
+
+private:
+  std::uint32_t queryIndex(std::uint32_t scope, bool stop) const;
+
+  vk::Device device;
+  vk::QueryPool queryPool;
+  float timestampPeriod;
+
+  std::uint32_t scopeCount;
+  std::uint32_t framesInFlight;
+  std::uint32_t frame = 0;
+
+  // Scopes that were written in every frame of the ring
+  std::vector<std::vector<bool>> written;
+  std::vector<float> lastMilliseconds;
+
+  GpuTimer(const GpuTimer&) = delete;
+  GpuTimer& operator=(const GpuTimer&) = delete;
+};
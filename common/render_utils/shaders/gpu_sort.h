@@ -0,0 +1,8 @@
+#ifndef GPU_SORT_H_INCLUDED
+#define GPU_SORT_H_INCLUDED
+
+// Pairs sorted in shared memory by one workgroup
+#define GPU_SORT_LOCAL_SIZE 2048
+#define GPU_SORT_THREADS    256
+
+#endif // GPU_SORT_H_INCLUDED
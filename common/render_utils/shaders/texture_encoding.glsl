@@ -0,0 +1,36 @@
+#ifndef TEXTURE_ENCODING_GLSL_INCLUDED
+#define TEXTURE_ENCODING_GLSL_INCLUDED
+
+// NOTE: .glsl extension is used for helper files with shader code
+
+// Octahedral unit vector encoding, two snorm channels instead of three
+vec2 encode_octahedral(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 e = n.xy;
+  if (n.z < 0.0)
+    e = (1.0 - abs(n.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+  return e;
+}
+
+vec3 decode_octahedral(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = clamp(-n.z, 0.0, 1.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
+// Values in [lo, hi] stored in a unorm channel
+float encode_unorm_range(float value, float lo, float hi)
+{
+  return clamp((value - lo) / (hi - lo), 0.0, 1.0);
+}
+
+float decode_unorm_range(float stored, float lo, float hi)
+{
+  return mix(lo, hi, stored);
+}
+
+#endif // TEXTURE_ENCODING_GLSL_INCLUDED
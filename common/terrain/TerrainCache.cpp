@@ -0,0 +1,103 @@
+#include "TerrainCache.hpp"
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+
+constexpr std::array<char, 4> CACHE_MAGIC{'T', 'R', 'N', 'C'};
+// Bump whenever the generation shaders change what they write
+constexpr std::uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader
+{
+  std::array<char, 4> magic;
+  std::uint32_t version;
+  TerrainCacheKey key;
+  std::uint64_t payloadBytes;
+};
+
+// FNV-1a, good enough to tell parameter sets apart, the header guards against collisions
+std::uint64_t hash_bytes(const void* data, std::size_t size)
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+CacheHeader make_header(const TerrainCacheKey& key, std::size_t payload_bytes)
+{
+  // Zeroed so that padding never makes equal keys compare different
+  CacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = CACHE_MAGIC;
+  header.version = CACHE_VERSION;
+  header.key = key;
+  header.payloadBytes = payload_bytes;
+  return header;
+}
+
+} // namespace
+
+std::filesystem::path terrain_cache_path(const TerrainCacheKey& key)
+{
+  const CacheHeader header = make_header(key, 0);
+  char name[32];
+  std::snprintf(
+    name, sizeof(name), "terrain_%016llx.bin", static_cast<unsigned long long>(hash_bytes(&header, sizeof(header))));
+  return std::filesystem::path(TERRAIN_CACHE_ROOT) / name;
+}
+
+bool load_terrain_cache(const TerrainCacheKey& key, std::span<std::byte> payload)
+{
+  std::ifstream file(terrain_cache_path(key), std::ios::binary);
+  if (!file)
+    return false;
+
+  CacheHeader header;
+  const CacheHeader expected = make_header(key, payload.size());
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      std::memcmp(&header, &expected, sizeof(header)) != 0)
+    return false;
+
+  return static_cast<bool>(
+    file.read(reinterpret_cast<char*>(payload.data()), static_cast<std::streamsize>(payload.size())));
+}
+
+void store_terrain_cache(const TerrainCacheKey& key, std::span<const std::byte> payload)
+{
+  const std::filesystem::path path = terrain_cache_path(key);
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+
+  // Written under a temporary name first, a crash never leaves a truncated file behind
+  std::filesystem::path temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    const CacheHeader header = make_header(key, payload.size());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size()));
+    if (!file)
+    {
+      spdlog::warn("Failed to write the terrain cache {}", temporary.string());
+      return;
+    }
+  }
+
+  std::filesystem::rename(temporary, path, error);
+  if (error)
+    spdlog::warn("Failed to store the terrain cache {}: {}", path.string(), error.message());
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+#include "shaders/terrain_params.h"
+
+/**
+ * On-disk copies of generated terrain maps, so startup can upload them instead of
+ * running the generation. Files are content addressed: the name is a hash of
+ * everything the maps depend on, and the header repeats the key to rule out collisions.
+ * The payload is the raw texels of the height map followed by the normal map,
+ * in the encoding of the images, so it can be read straight into a staging buffer.
+ */
+struct TerrainCacheKey
+{
+  PerlinParams params;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t encoding;
+};
+
+std::filesystem::path terrain_cache_path(const TerrainCacheKey& key);
+
+// Fills payload from the file of the key, false if there is none or it does not match
+bool load_terrain_cache(const TerrainCacheKey& key, std::span<std::byte> payload);
+// Failures are only logged, the cache is an optimization
+void store_terrain_cache(const TerrainCacheKey& key, std::span<const std::byte> payload);
@@ -0,0 +1,952 @@
+#include "TerrainRenderer.hpp"
+#include "TerrainCache.hpp"
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <limits>
+
+#include "render_utils/Barriers.hpp"
+#include "render_utils/Frustum.hpp"
+
+void TerrainRenderer::allocateResources(
+  etna::Buffer&  in_constants,
+  etna::Buffer&  in_uniform_params_buffer,
+  etna::Sampler& in_default_sampler)
+{
+  this->constants             = &in_constants;
+  this->uniform_params_buffer = &in_uniform_params_buffer;
+  this->default_sampler       = &in_default_sampler;
+
+  auto& ctx = etna::get_context();
+
+  for (std::size_t i = 0; i < heightBoundsBuffers.size(); ++i)
+    heightBoundsBuffers[i] = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = sizeof(glm::vec2) * bounds_level_offset(TERRAIN_BOUNDS_LEVELS),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = i == 0 ? "terrain_height_bounds_0" : "terrain_height_bounds_1",
+    });
+
+  heightBoundsReadback = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(glm::vec2) * CPU_BOUNDS_CELLS,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "terrain_height_bounds_readback",
+  });
+  heightBoundsReadbackMapping = heightBoundsReadback.map();
+
+  visiblePatchBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * getPatchCount(),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "terrain_visible_patches",
+  });
+
+  patchDrawArgsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(vk::DrawIndirectCommand),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+      vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "terrain_patch_draw_args",
+  });
+
+  patchStatsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(vk::DrawIndirectCommand),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "terrain_patch_stats",
+  });
+  patchStatsMapping = patchStatsBuffer.map();
+  std::memset(patchStatsMapping, 0, sizeof(vk::DrawIndirectCommand));
+
+  cdlodNodeBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(TerrainCdlodNode) * MAX_CDLOD_NODES * FRAME_RING,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "terrain_cdlod_nodes",
+  });
+  cdlodNodeMapping = cdlodNodeBuffer.map();
+
+  virtualHeightmap.allocateResources();
+
+  createTerrainImages();
+  regenerateImmediately();
+}
+
+namespace
+{
+
+// Vertices of a CDLOD level start morphing at this fraction of the level's range
+constexpr float CDLOD_MORPH_START = 0.7f;
+constexpr float CDLOD_TERRAIN_SIZE = TERRAIN_PATCH_GRID * TERRAIN_PATCH_SIZE;
+static_assert(TERRAIN_CDLOD_LEAF_SIZE * (1u << (TERRAIN_CDLOD_LEVELS - 1)) == CDLOD_TERRAIN_SIZE);
+
+struct CdlodSelection
+{
+  glm::vec4 frustumPlanes[6];
+  glm::vec3 cameraPos;
+  // Nodes past it are not drawn at all
+  float maxDistance;
+  // Level 0 is the finest one
+  std::array<float, TERRAIN_CDLOD_LEVELS> ranges;
+  std::vector<TerrainCdlodNode>* fullNodes;
+  std::vector<TerrainCdlodNode>* quarterNodes;
+};
+
+struct CdlodBox
+{
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+CdlodBox cdlod_node_box(glm::vec2 offset, float size)
+{
+  // Heights are not known on the CPU, nodes get the full height range of the terrain
+  const float minY = TERRAIN_ORIGIN_Y + TERRAIN_HEIGHT_MIN * TERRAIN_HEIGHT_SCALE;
+  const float maxY = TERRAIN_ORIGIN_Y + TERRAIN_HEIGHT_MAX * TERRAIN_HEIGHT_SCALE;
+  const float minX = TERRAIN_ORIGIN_X + offset.x;
+  const float maxZ = TERRAIN_ORIGIN_Z + CDLOD_TERRAIN_SIZE - offset.y;
+  return CdlodBox{
+    .min = glm::vec3(minX, minY, maxZ - size),
+    .max = glm::vec3(minX + size, maxY, maxZ),
+  };
+}
+
+bool box_in_frustum(const CdlodBox& box, const glm::vec4 (&planes)[6])
+{
+  return std::ranges::all_of(planes, [&](const glm::vec4& plane) {
+    const glm::vec3 farthest = glm::mix(box.min, box.max, glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.0f)));
+    return glm::dot(glm::vec3(plane), farthest) + plane.w >= 0.0f;
+  });
+}
+
+bool box_in_range(const CdlodBox& box, glm::vec3 point, float range)
+{
+  const glm::vec3 closest = glm::clamp(point, box.min, box.max);
+  const glm::vec3 delta = closest - point;
+  return glm::dot(delta, delta) <= range * range;
+}
+
+TerrainCdlodNode make_cdlod_node(
+  glm::vec2 offset, float size, std::uint32_t level, const std::array<float, TERRAIN_CDLOD_LEVELS>& ranges)
+{
+  return TerrainCdlodNode{
+    .offsetU = offset.x,
+    .offsetV = offset.y,
+    .size = size,
+    .morphStart = ranges[level] * CDLOD_MORPH_START,
+    .morphEnd = ranges[level],
+    .pad0 = 0,
+    .pad1 = 0,
+    .pad2 = 0,
+  };
+}
+
+// Returns false if the node is out of the range of its level, the parent covers its area then
+bool select_cdlod_node(CdlodSelection& selection, glm::vec2 offset, float size, std::uint32_t level)
+{
+  const CdlodBox box = cdlod_node_box(offset, size);
+  if (!box_in_range(box, selection.cameraPos, selection.ranges[level]))
+    return false;
+  // Culled nodes count as selected, there is nothing to draw for them
+  if (!box_in_frustum(box, selection.frustumPlanes) || !box_in_range(box, selection.cameraPos, selection.maxDistance))
+    return true;
+
+  if (level == 0 || !box_in_range(box, selection.cameraPos, selection.ranges[level - 1]))
+  {
+    selection.fullNodes->push_back(make_cdlod_node(offset, size, level, selection.ranges));
+    return true;
+  }
+
+  const float half = size * 0.5f;
+  for (std::uint32_t child = 0; child < 4; ++child)
+  {
+    const glm::vec2 childOffset = offset + glm::vec2(child % 2, child / 2) * half;
+    if (select_cdlod_node(selection, childOffset, half, level - 1))
+      continue;
+    const CdlodBox childBox = cdlod_node_box(childOffset, half);
+    if (box_in_frustum(childBox, selection.frustumPlanes) && box_in_range(childBox, selection.cameraPos, selection.maxDistance))
+      selection.quarterNodes->push_back(make_cdlod_node(childOffset, half, level, selection.ranges));
+  }
+  return true;
+}
+
+struct CdlodStreamedPushConstants
+{
+  std::uint32_t gridQuads;
+  std::uint32_t pageTableOffset;
+  glm::ivec2 windowOrigin;
+};
+
+struct PerlinPushConstants
+{
+  glm::uvec2 tileOffset;
+  PerlinParams params;
+};
+
+vk::Format height_map_format(TerrainTextureEncoding encoding)
+{
+  return encoding == TerrainTextureEncoding::Compact ? vk::Format::eR16Unorm : vk::Format::eR32Sfloat;
+}
+
+vk::Format normal_map_format(TerrainTextureEncoding encoding)
+{
+  return encoding == TerrainTextureEncoding::Compact ? vk::Format::eR8G8Snorm : vk::Format::eR16G16Snorm;
+}
+
+std::size_t bytes_per_texel(vk::Format format)
+{
+  switch (format)
+  {
+  case vk::Format::eR8G8Snorm:
+  case vk::Format::eR16Unorm:
+    return 2;
+  case vk::Format::eR32Sfloat:
+  case vk::Format::eR16G16Snorm:
+    return 4;
+  default:
+    return 16;
+  }
+}
+
+} // namespace
+
+void TerrainRenderer::createTerrainImages()
+{
+  auto& ctx = etna::get_context();
+
+  for (std::size_t i = 0; i < heightImages.size(); ++i)
+  {
+    heightImages[i] = ctx.createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{terrainTextureSizeWidth, terrainTextureSizeHeight, 1},
+      .name = i == 0 ? "perlin_noise_0" : "perlin_noise_1",
+      .format = height_map_format(textureEncoding),
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage |
+        vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst});
+
+    normalImages[i] = ctx.createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{terrainTextureSizeWidth, terrainTextureSizeHeight, 1},
+      .name = i == 0 ? "normal_map_terrain_0" : "normal_map_terrain_1",
+      .format = normal_map_format(textureEncoding),
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage |
+        vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst});
+  }
+}
+
+void TerrainRenderer::setTextureEncoding(TerrainTextureEncoding encoding)
+{
+  if (encoding == textureEncoding)
+    return;
+  textureEncoding = encoding;
+
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+  createTerrainImages();
+  regenerateImmediately();
+}
+
+void TerrainRenderer::regenerateImmediately()
+{
+  regenerationActive = false;
+  regenerationRequested = false;
+
+  auto& ctx = etna::get_context();
+  const TerrainCacheKey cacheKey{
+    .params = perlinParams,
+    .width = terrainTextureSizeWidth,
+    .height = terrainTextureSizeHeight,
+    .encoding = static_cast<std::uint32_t>(textureEncoding),
+  };
+  const std::size_t heightBytes = getHeightMapBytes();
+  const std::size_t normalBytes = getNormalMapBytes();
+
+  // Staging for both maps, filled from the cache file or from the generated images
+  etna::Buffer staging = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = heightBytes + normalBytes,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "terrain_cache_staging",
+  });
+  const std::span<std::byte> payload(reinterpret_cast<std::byte*>(staging.map()), heightBytes + normalBytes);
+  loadedFromCache = load_terrain_cache(cacheKey, payload);
+
+  const vk::Extent3D extent{terrainTextureSizeWidth, terrainTextureSizeHeight, 1};
+  auto mapRegion = [&](vk::DeviceSize offset) {
+    return vk::BufferImageCopy{
+      .bufferOffset = offset,
+      .imageSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+      .imageExtent = extent,
+    };
+  };
+
+  auto cmdManager = ctx.createOneShotCmdMgr();
+  auto cmdBuf = cmdManager->start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+
+  if (loadedFromCache)
+  {
+    regenerationParams = perlinParams;
+    const std::uint32_t back = 1 - frontImages;
+    for (const etna::Image* image : {&heightImages[back], &normalImages[back]})
+      etna::set_state(
+        cmdBuf,
+        image->get(),
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmdBuf);
+    cmdBuf.copyBufferToImage(
+      staging.get(), heightImages[back].get(), vk::ImageLayout::eTransferDstOptimal, {mapRegion(0)});
+    cmdBuf.copyBufferToImage(
+      staging.get(), normalImages[back].get(), vk::ImageLayout::eTransferDstOptimal, {mapRegion(heightBytes)});
+    finishRegeneration(cmdBuf);
+  }
+  else
+  {
+    regenerationRequested = true;
+    recordRegeneration(cmdBuf, std::numeric_limits<std::uint32_t>::max());
+
+    // Copies of the fresh maps for the next startup
+    for (const etna::Image* image : {&heightImages[frontImages], &normalImages[frontImages]})
+      etna::set_state(
+        cmdBuf,
+        image->get(),
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferRead,
+        vk::ImageLayout::eTransferSrcOptimal,
+        vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmdBuf);
+    cmdBuf.copyImageToBuffer(
+      heightImages[frontImages].get(), vk::ImageLayout::eTransferSrcOptimal, staging.get(), {mapRegion(0)});
+    cmdBuf.copyImageToBuffer(
+      normalImages[frontImages].get(), vk::ImageLayout::eTransferSrcOptimal, staging.get(), {mapRegion(heightBytes)});
+    memory_barrier(
+      cmdBuf,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::PipelineStageFlagBits2::eHost,
+      vk::AccessFlagBits2::eHostRead);
+    recordDisplayStates(cmdBuf, frontImages);
+  }
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  cmdManager->submitAndWait(cmdBuf);
+
+  if (!loadedFromCache)
+    store_terrain_cache(cacheKey, payload);
+}
+
+std::size_t TerrainRenderer::getHeightMapBytes() const
+{
+  return std::size_t{terrainTextureSizeWidth} * terrainTextureSizeHeight *
+    bytes_per_texel(height_map_format(textureEncoding));
+}
+
+std::size_t TerrainRenderer::getNormalMapBytes() const
+{
+  return std::size_t{terrainTextureSizeWidth} * terrainTextureSizeHeight *
+    bytes_per_texel(normal_map_format(textureEncoding));
+}
+
+std::size_t TerrainRenderer::getMemoryBytes() const
+{
+  const std::size_t maps = heightImages.size() * (getHeightMapBytes() + getNormalMapBytes());
+  const std::size_t bounds =
+    heightBoundsBuffers.size() * sizeof(glm::vec2) * bounds_level_offset(TERRAIN_BOUNDS_LEVELS) +
+    sizeof(glm::vec2) * CPU_BOUNDS_CELLS;
+  const std::size_t patches = sizeof(std::uint32_t) * getPatchCount() + 2 * sizeof(vk::DrawIndirectCommand);
+  const std::size_t nodes = sizeof(TerrainCdlodNode) * MAX_CDLOD_NODES * FRAME_RING;
+  return maps + bounds + patches + nodes + virtualHeightmap.getMemoryBytes();
+}
+
+void TerrainRenderer::loadShaders()
+{
+  etna::create_program("terrain_generate", {TERRAIN_SHADERS_ROOT "terrain_generate.comp.spv"});
+  etna::create_program("terrain_generate_compact", {TERRAIN_SHADERS_ROOT "terrain_generate_compact.comp.spv"});
+  etna::create_program("terrain_bounds_base", {TERRAIN_SHADERS_ROOT "terrain_bounds_base.comp.spv"});
+  etna::create_program("terrain_bounds_reduce", {TERRAIN_SHADERS_ROOT "terrain_bounds_reduce.comp.spv"});
+  etna::create_program("terrain_patch_cull", {TERRAIN_SHADERS_ROOT "terrain_patch_cull.comp.spv"});
+  etna::create_program(
+    "terrain_cdlod_render",
+    {TERRAIN_SHADERS_ROOT "terrain_cdlod.vert.spv", TERRAIN_SHADERS_ROOT "terrain.frag.spv"});
+  etna::create_program(
+    "terrain_cdlod_streamed_render",
+    {TERRAIN_SHADERS_ROOT "terrain_cdlod_streamed.vert.spv",
+     TERRAIN_SHADERS_ROOT "terrain_streamed.frag.spv"});
+  virtualHeightmap.loadShaders();
+  etna::create_program(
+    "terrain_render",
+    {TERRAIN_SHADERS_ROOT "terrain.vert.spv",
+     TERRAIN_SHADERS_ROOT "terrain.tesc.spv",
+     TERRAIN_SHADERS_ROOT "terrain.tese.spv",
+     TERRAIN_SHADERS_ROOT "terrain.frag.spv"});
+}
+
+void TerrainRenderer::setupPipelines(vk::Format swapchain_format)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+
+  generatePipelines[static_cast<std::size_t>(TerrainTextureEncoding::Precise)] =
+    pipelineManager.createComputePipeline("terrain_generate", {});
+  generatePipelines[static_cast<std::size_t>(TerrainTextureEncoding::Compact)] =
+    pipelineManager.createComputePipeline("terrain_generate_compact", {});
+  boundsBasePipeline   = pipelineManager.createComputePipeline("terrain_bounds_base", {});
+  boundsReducePipeline = pipelineManager.createComputePipeline("terrain_bounds_reduce", {});
+  patchCullPipeline   = pipelineManager.createComputePipeline("terrain_patch_cull", {});
+  terrainPipeline = pipelineManager.createGraphicsPipeline(
+    "terrain_render",
+    etna::GraphicsPipeline::CreateInfo{
+      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eBack,
+          .frontFace = vk::FrontFace::eCounterClockwise,
+          .lineWidth = 1.f,
+        },
+      .fragmentShaderOutput =
+      {
+        .colorAttachmentFormats = {swapchain_format},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      },
+    }
+  );
+  const etna::GraphicsPipeline::CreateInfo cdlodPipelineInfo{
+    .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::eTriangleList},
+    .rasterizationConfig =
+      vk::PipelineRasterizationStateCreateInfo{
+        .polygonMode = vk::PolygonMode::eFill,
+        .cullMode = vk::CullModeFlagBits::eBack,
+        .frontFace = vk::FrontFace::eCounterClockwise,
+        .lineWidth = 1.f,
+      },
+    .fragmentShaderOutput =
+    {
+      .colorAttachmentFormats = {swapchain_format},
+      .depthAttachmentFormat = vk::Format::eD32Sfloat,
+    },
+  };
+  terrainCdlodPipeline = pipelineManager.createGraphicsPipeline("terrain_cdlod_render", cdlodPipelineInfo);
+  terrainCdlodStreamedPipeline =
+    pipelineManager.createGraphicsPipeline("terrain_cdlod_streamed_render", cdlodPipelineInfo);
+  virtualHeightmap.setupPipelines();
+}
+
+void TerrainRenderer::update(const PerlinParams& params)
+{
+  if (std::memcmp(&params, &perlinParams, sizeof(PerlinParams)) == 0)
+    return;
+  perlinParams = params;
+  regenerationRequested = true;
+}
+
+void TerrainRenderer::selectNodes(glm::vec3 camera_pos, const glm::mat4& view_proj)
+{
+  cdlodFullNodes.clear();
+  cdlodQuarterNodes.clear();
+  cdlodFullNodeCount = 0;
+  cdlodQuarterNodeCount = 0;
+  if (renderMode == TerrainRenderMode::Tessellation)
+    return;
+
+  const bool streamed = renderMode == TerrainRenderMode::StreamedCdlod;
+  CdlodSelection selection{
+    .cameraPos = camera_pos,
+    // Drawn nodes stay within the streamed pages, with a page of margin for the ones still generating
+    .maxDistance = streamed ? VirtualHeightmap::STREAM_RADIUS - float(TERRAIN_PAGE_SIZE) : std::numeric_limits<float>::max(),
+    .fullNodes = &cdlodFullNodes,
+    .quarterNodes = &cdlodQuarterNodes,
+  };
+  extract_frustum_planes(view_proj, selection.frustumPlanes);
+  float range = cdlodDetailDistance;
+  for (float& levelRange : selection.ranges)
+  {
+    levelRange = range;
+    range *= 2.0f;
+  }
+  // The root covers everything, there is no coarser level to hand over to
+  selection.ranges.back() = std::numeric_limits<float>::max();
+  if (!streamed)
+    select_cdlod_node(selection, glm::vec2(0.0f), CDLOD_TERRAIN_SIZE, TERRAIN_CDLOD_LEVELS - 1);
+  else
+  {
+    // Streamed terrain space is tiled with quadtree roots of the fixed terrain's size
+    const glm::vec2 cameraTerrainPos{
+      camera_pos.x - TERRAIN_ORIGIN_X, TERRAIN_ORIGIN_Z + CDLOD_TERRAIN_SIZE - camera_pos.z};
+    virtualHeightmap.update(cameraTerrainPos, perlinParams);
+
+    const glm::ivec2 minRoot(glm::floor((cameraTerrainPos - selection.maxDistance) / CDLOD_TERRAIN_SIZE));
+    const glm::ivec2 maxRoot(glm::floor((cameraTerrainPos + selection.maxDistance) / CDLOD_TERRAIN_SIZE));
+    for (int y = minRoot.y; y <= maxRoot.y; ++y)
+      for (int x = minRoot.x; x <= maxRoot.x; ++x)
+        select_cdlod_node(selection, glm::vec2(x, y) * CDLOD_TERRAIN_SIZE, CDLOD_TERRAIN_SIZE, TERRAIN_CDLOD_LEVELS - 1);
+  }
+
+  // Only an extreme detail distance overflows a section, the excess nodes are dropped
+  cdlodFullNodeCount = std::min(static_cast<std::uint32_t>(cdlodFullNodes.size()), MAX_CDLOD_NODES);
+  cdlodQuarterNodeCount =
+    std::min(static_cast<std::uint32_t>(cdlodQuarterNodes.size()), MAX_CDLOD_NODES - cdlodFullNodeCount);
+
+  cdlodFrameSection = (cdlodFrameSection + 1) % FRAME_RING;
+  auto* section = static_cast<TerrainCdlodNode*>(cdlodNodeMapping) + cdlodFrameSection * MAX_CDLOD_NODES;
+  std::memcpy(section, cdlodFullNodes.data(), cdlodFullNodeCount * sizeof(TerrainCdlodNode));
+  std::memcpy(
+    section + cdlodFullNodeCount, cdlodQuarterNodes.data(), cdlodQuarterNodeCount * sizeof(TerrainCdlodNode));
+}
+
+void TerrainRenderer::render(vk::CommandBuffer cmd_buf)
+{
+  if (renderMode != TerrainRenderMode::Tessellation)
+  {
+    renderCdlod(cmd_buf);
+    return;
+  }
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, terrainPipeline.getVkPipeline());
+
+  auto info = etna::get_shader_program("terrain_render");
+  auto perlinBind = heightImages[frontImages].genBinding(default_sampler->get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+  auto normalBind = normalImages[frontImages].genBinding(default_sampler->get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+
+  auto descSet = etna::create_descriptor_set(
+    info.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, perlinBind},
+      etna::Binding{1, normalBind},
+      etna::Binding{2, constants->genBinding()},
+      etna::Binding{3, uniform_params_buffer->genBinding()},
+      etna::Binding{4, visiblePatchBuffer.genBinding()},
+    });
+  auto vkSet = descSet.getVkSet();
+  auto layout = terrainPipeline.getVkPipelineLayout();
+
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &vkSet, 0, nullptr);
+
+  // One instance per patch that survived cullPatches
+  cmd_buf.drawIndirect(patchDrawArgsBuffer.get(), 0, 1, 0);
+}
+
+void TerrainRenderer::renderCdlod(vk::CommandBuffer cmd_buf)
+{
+  const bool streamed = renderMode == TerrainRenderMode::StreamedCdlod;
+  const auto& pipeline = streamed ? terrainCdlodStreamedPipeline : terrainCdlodPipeline;
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+
+  // The streamed variant computes normals from the pages
+  auto descSet = streamed
+    ? etna::create_descriptor_set(
+        etna::get_shader_program("terrain_cdlod_streamed_render").getDescriptorLayoutId(0),
+        cmd_buf,
+        {
+          etna::Binding{0, virtualHeightmap.getPageAtlas().genBinding(default_sampler->get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+          etna::Binding{2, constants->genBinding()},
+          etna::Binding{3, uniform_params_buffer->genBinding()},
+          etna::Binding{4, cdlodNodeBuffer.genBinding()},
+          etna::Binding{5, virtualHeightmap.getPageTable().genBinding()},
+        })
+    : etna::create_descriptor_set(
+        etna::get_shader_program("terrain_cdlod_render").getDescriptorLayoutId(0),
+        cmd_buf,
+        {
+          etna::Binding{0, heightImages[frontImages].genBinding(default_sampler->get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+          etna::Binding{1, normalImages[frontImages].genBinding(default_sampler->get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+          etna::Binding{2, constants->genBinding()},
+          etna::Binding{3, uniform_params_buffer->genBinding()},
+          etna::Binding{4, cdlodNodeBuffer.genBinding()},
+        });
+  auto vkSet = descSet.getVkSet();
+  auto layout = pipeline.getVkPipelineLayout();
+
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &vkSet, 0, nullptr);
+
+  // Quarters keep the grid spacing of their level, so they take half the grid
+  const std::uint32_t firstNode = cdlodFrameSection * MAX_CDLOD_NODES;
+  const std::uint32_t fullGrid = TERRAIN_CDLOD_GRID;
+  const std::uint32_t quarterGrid = TERRAIN_CDLOD_GRID / 2;
+  auto pushGrid = [&](std::uint32_t grid_quads) {
+    if (streamed)
+    {
+      const CdlodStreamedPushConstants pushConstants{
+        .gridQuads = grid_quads,
+        .pageTableOffset = virtualHeightmap.getPageTableOffset(),
+        .windowOrigin = virtualHeightmap.getWindowOrigin(),
+      };
+      cmd_buf.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(pushConstants), &pushConstants);
+    }
+    else
+      cmd_buf.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(grid_quads), &grid_quads);
+  };
+
+  pushGrid(fullGrid);
+  cmd_buf.draw(fullGrid * fullGrid * 6, cdlodFullNodeCount, 0, firstNode);
+
+  pushGrid(quarterGrid);
+  cmd_buf.draw(quarterGrid * quarterGrid * 6, cdlodQuarterNodeCount, 0, firstNode + cdlodFullNodeCount);
+}
+
+void TerrainRenderer::cullPatches(vk::CommandBuffer cmd_buf)
+{
+  if (renderMode != TerrainRenderMode::Tessellation)
+    return;
+
+  vk::DrawIndirectCommand stats;
+  std::memcpy(&stats, patchStatsMapping, sizeof(stats));
+  visiblePatchCount = stats.instanceCount;
+
+  // The previous frame must be done drawing before the list and the arguments are overwritten
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eDrawIndirect |
+      vk::PipelineStageFlagBits2::eTransfer,
+    {},
+    vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+    {});
+
+  const vk::DrawIndirectCommand emptyArgs{.vertexCount = 4, .instanceCount = 0, .firstVertex = 0, .firstInstance = 0};
+  cmd_buf.updateBuffer(patchDrawArgsBuffer.get(), 0, sizeof(emptyArgs), &emptyArgs);
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite);
+
+  auto shaderInfo = etna::get_shader_program("terrain_patch_cull");
+  auto descSet = etna::create_descriptor_set(
+    shaderInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, constants->genBinding()},
+      etna::Binding{1, heightBoundsBuffers[frontImages].genBinding()},
+      etna::Binding{2, visiblePatchBuffer.genBinding()},
+      etna::Binding{3, patchDrawArgsBuffer.genBinding()},
+    });
+
+  const std::uint32_t cullEnabled = enablePatchCulling ? 1 : 0;
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, patchCullPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, patchCullPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+  cmd_buf.pushConstants(
+    patchCullPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(cullEnabled), &cullEnabled);
+  cmd_buf.dispatch((getPatchCount() + TERRAIN_CULL_WORKGROUP_SIZE - 1) / TERRAIN_CULL_WORKGROUP_SIZE, 1, 1);
+
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite,
+    vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eDrawIndirect |
+      vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eIndirectCommandRead |
+      vk::AccessFlagBits2::eTransferRead);
+  cmd_buf.copyBuffer(
+    patchDrawArgsBuffer.get(), patchStatsBuffer.get(), {vk::BufferCopy{0, 0, sizeof(vk::DrawIndirectCommand)}});
+}
+
+void TerrainRenderer::regenerateTerrain()
+{
+  regenerationRequested = true;
+}
+
+void TerrainRenderer::updateTerrainMaps(vk::CommandBuffer cmd_buf)
+{
+  if (heightBoundsReadbackFrames > 0 && --heightBoundsReadbackFrames == 0)
+  {
+    cpuHeightBounds.resize(CPU_BOUNDS_CELLS);
+    std::memcpy(cpuHeightBounds.data(), heightBoundsReadbackMapping, sizeof(glm::vec2) * CPU_BOUNDS_CELLS);
+  }
+
+  recordRegeneration(cmd_buf, regenerationTilesPerFrame);
+  if (renderMode == TerrainRenderMode::StreamedCdlod)
+    virtualHeightmap.generatePages(cmd_buf);
+}
+
+float TerrainRenderer::getRegenerationProgress() const
+{
+  if (!regenerationActive)
+    return 1.0f;
+  const std::uint32_t tilesX = (terrainTextureSizeWidth + REGENERATION_TILE_SIZE - 1) / REGENERATION_TILE_SIZE;
+  const std::uint32_t tilesY = (terrainTextureSizeHeight + REGENERATION_TILE_SIZE - 1) / REGENERATION_TILE_SIZE;
+  return static_cast<float>(regenerationStep) / static_cast<float>(tilesX * tilesY);
+}
+
+void TerrainRenderer::recordRegeneration(vk::CommandBuffer cmd_buf, std::uint32_t tile_budget)
+{
+  if (!regenerationActive)
+  {
+    if (!regenerationRequested)
+      return;
+    // Parameters are fixed for the whole regeneration, later edits queue up the next one
+    regenerationRequested = false;
+    regenerationActive = true;
+    regenerationParams = perlinParams;
+    regenerationStep = 0;
+  }
+
+  const std::uint32_t tilesX = (terrainTextureSizeWidth + REGENERATION_TILE_SIZE - 1) / REGENERATION_TILE_SIZE;
+  const std::uint32_t tilesY = (terrainTextureSizeHeight + REGENERATION_TILE_SIZE - 1) / REGENERATION_TILE_SIZE;
+  const std::uint32_t tileCount = tilesX * tilesY;
+  // Tiles at the right and bottom edges may be partial, the shader skips texels past the maps
+  const std::uint32_t groupsPerTile =
+    (REGENERATION_TILE_SIZE + TERRAIN_GENERATE_GROUP_SIZE - 1) / TERRAIN_GENERATE_GROUP_SIZE;
+  const std::uint32_t firstStep = regenerationStep;
+  const std::uint32_t lastStep = std::min(tileCount, firstStep + std::min(tile_budget, tileCount));
+
+  const std::uint32_t back = 1 - frontImages;
+  const etna::Image& heightImage = heightImages[back];
+  const etna::Image& normalImage = normalImages[back];
+  const bool compact = textureEncoding == TerrainTextureEncoding::Compact;
+  const std::size_t encoding = static_cast<std::size_t>(textureEncoding);
+
+  // Heights and normals of a tile in one pass
+  if (firstStep < lastStep)
+  {
+    etna::set_state(
+      cmd_buf,
+      heightImage.get(),
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderWrite,
+      vk::ImageLayout::eGeneral,
+      vk::ImageAspectFlagBits::eColor);
+    etna::set_state(
+      cmd_buf,
+      normalImage.get(),
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderWrite,
+      vk::ImageLayout::eGeneral,
+      vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmd_buf);
+
+    const auto& generatePipeline = generatePipelines[encoding];
+    auto generateInfo = etna::get_shader_program(compact ? "terrain_generate_compact" : "terrain_generate");
+
+    auto set = etna::create_descriptor_set(
+      generateInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, heightImage.genBinding(default_sampler->get(), vk::ImageLayout::eGeneral, {})},
+        etna::Binding{1, normalImage.genBinding(default_sampler->get(), vk::ImageLayout::eGeneral, {})},
+      });
+
+    vk::DescriptorSet vkSet = set.getVkSet();
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, generatePipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      generatePipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+
+    for (std::uint32_t tile = firstStep; tile < lastStep; ++tile)
+    {
+      const PerlinPushConstants pushConstants{
+        .tileOffset = glm::uvec2(tile % tilesX, tile / tilesX) * REGENERATION_TILE_SIZE,
+        .params = regenerationParams,
+      };
+      cmd_buf.pushConstants(
+        generatePipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+      cmd_buf.dispatch(groupsPerTile, groupsPerTile, 1);
+    }
+  }
+
+  regenerationStep = lastStep;
+  if (regenerationStep < tileCount)
+    return;
+
+  // Done, the back maps become the displayed ones
+  finishRegeneration(cmd_buf);
+}
+
+void TerrainRenderer::finishRegeneration(vk::CommandBuffer cmd_buf)
+{
+  const std::uint32_t back = 1 - frontImages;
+  etna::set_state(
+    cmd_buf,
+    heightImages[back].get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+  recordHeightBounds(cmd_buf, heightImages[back], heightBoundsBuffers[back]);
+
+  recordDisplayStates(cmd_buf, back);
+  frontImages = back;
+  regenerationActive = false;
+}
+
+void TerrainRenderer::recordDisplayStates(vk::CommandBuffer cmd_buf, std::uint32_t images)
+{
+  // Applications may sample heights in compute, CDLOD does in vertex shaders
+  etna::set_state(
+    cmd_buf,
+    heightImages[images].get(),
+    vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eVertexShader |
+      vk::PipelineStageFlagBits2::eTessellationEvaluationShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+
+  etna::set_state(
+    cmd_buf,
+    normalImages[images].get(),
+    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
+
+void TerrainRenderer::recordHeightBounds(
+  vk::CommandBuffer cmd_buf, const etna::Image& height_image, const etna::Buffer& bounds_buffer)
+{
+  // Culling may still read this buffer from before the last swap
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer,
+    {},
+    vk::PipelineStageFlagBits2::eComputeShader,
+    {});
+
+  {
+    auto baseInfo = etna::get_shader_program("terrain_bounds_base");
+    auto set = etna::create_descriptor_set(
+      baseInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, height_image.genBinding(default_sampler->get(), vk::ImageLayout::eGeneral, {})},
+        etna::Binding{1, bounds_buffer.genBinding()},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, boundsBasePipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, boundsBasePipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+    cmd_buf.dispatch(TERRAIN_BOUNDS_BASE_SIZE, TERRAIN_BOUNDS_BASE_SIZE, 1);
+  }
+
+  auto reduceInfo = etna::get_shader_program("terrain_bounds_reduce");
+  auto set = etna::create_descriptor_set(
+    reduceInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, bounds_buffer.genBinding()},
+    });
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, boundsReducePipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, boundsReducePipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+
+  for (std::uint32_t level = 1; level < TERRAIN_BOUNDS_LEVELS; ++level)
+  {
+    memory_barrier(
+      cmd_buf,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderWrite,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderWrite);
+
+    const std::uint32_t size = TERRAIN_BOUNDS_BASE_SIZE >> level;
+    cmd_buf.pushConstants(
+      boundsReducePipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(level), &level);
+    cmd_buf.dispatch((size * size + TERRAIN_BOUNDS_WORKGROUP_SIZE - 1) / TERRAIN_BOUNDS_WORKGROUP_SIZE, 1, 1);
+  }
+
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite,
+    vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eTransferRead);
+
+  // Coarse levels for queries on the CPU, readable once the frames in flight are done
+  cmd_buf.copyBuffer(
+    bounds_buffer.get(),
+    heightBoundsReadback.get(),
+    {vk::BufferCopy{
+      sizeof(glm::vec2) * bounds_level_offset(CPU_BOUNDS_FIRST_LEVEL), 0, sizeof(glm::vec2) * CPU_BOUNDS_CELLS}});
+  heightBoundsReadbackFrames = FRAME_RING;
+  // The old copy does not bound the new heights, queries fall back to the full range until then
+  cpuHeightBounds.clear();
+}
+
+TerrainHeightRange TerrainRenderer::queryHeightRange(glm::vec2 world_min_xz, glm::vec2 world_max_xz) const
+{
+  const TerrainHeightRange fullRange{
+    TERRAIN_HEIGHT_MIN * TERRAIN_HEIGHT_SCALE, TERRAIN_HEIGHT_MAX * TERRAIN_HEIGHT_SCALE};
+  if (cpuHeightBounds.empty())
+    return fullRange;
+
+  // World xz to texture space, rows run against world z
+  const float terrainSize = static_cast<float>(TERRAIN_GRID_SIZE);
+  const glm::vec2 uvMin{
+    (world_min_xz.x - TERRAIN_ORIGIN_X) / terrainSize, (TERRAIN_ORIGIN_Z + terrainSize - world_max_xz.y) / terrainSize};
+  const glm::vec2 uvMax{
+    (world_max_xz.x - TERRAIN_ORIGIN_X) / terrainSize, (TERRAIN_ORIGIN_Z + terrainSize - world_min_xz.y) / terrainSize};
+  if (uvMax.x < 0.0f || uvMax.y < 0.0f || uvMin.x > 1.0f || uvMin.y > 1.0f)
+    return fullRange;
+
+  // Finest level on which the region spans a handful of cells
+  std::uint32_t level = CPU_BOUNDS_FIRST_LEVEL;
+  glm::ivec2 firstCell;
+  glm::ivec2 lastCell;
+  for (;; ++level)
+  {
+    const float size = static_cast<float>(TERRAIN_BOUNDS_BASE_SIZE >> level);
+    firstCell = glm::ivec2(glm::clamp(glm::floor(uvMin * size), glm::vec2(0.0f), glm::vec2(size - 1.0f)));
+    lastCell = glm::ivec2(glm::clamp(glm::floor(uvMax * size), glm::vec2(0.0f), glm::vec2(size - 1.0f)));
+    const glm::ivec2 span = lastCell - firstCell + 1;
+    if (span.x * span.y <= 16 || level + 1 == TERRAIN_BOUNDS_LEVELS)
+      break;
+  }
+
+  const std::uint32_t size = TERRAIN_BOUNDS_BASE_SIZE >> level;
+  const std::uint32_t offset = bounds_level_offset(level) - bounds_level_offset(CPU_BOUNDS_FIRST_LEVEL);
+  TerrainHeightRange range{fullRange.max, fullRange.min};
+  for (int y = firstCell.y; y <= lastCell.y; ++y)
+    for (int x = firstCell.x; x <= lastCell.x; ++x)
+    {
+      const glm::vec2 bounds = cpuHeightBounds[offset + y * size + x];
+      range.min = std::min(range.min, bounds.x);
+      range.max = std::max(range.max, bounds.y);
+    }
+  return range;
+}
+
+void TerrainRenderer::setTerrainTextureSizeWidth(std::uint32_t w)
+{
+  resizeTerrainImages(w, terrainTextureSizeHeight);
+}
+
+void TerrainRenderer::setTerrainTextureSizeHeight(std::uint32_t h)
+{
+  resizeTerrainImages(terrainTextureSizeWidth, h);
+}
+
+void TerrainRenderer::resizeTerrainImages(std::uint32_t width, std::uint32_t height)
+{
+  const std::uint32_t maxSize =
+    etna::get_context().getPhysicalDevice().getProperties().limits.maxImageDimension2D;
+  width = std::clamp(width, 1u, maxSize);
+  height = std::clamp(height, 1u, maxSize);
+  if (width == terrainTextureSizeWidth && height == terrainTextureSizeHeight)
+    return;
+
+  terrainTextureSizeWidth = width;
+  terrainTextureSizeHeight = height;
+
+  // The maps, the memory report and the cache key all follow the new size
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+  createTerrainImages();
+  regenerateImmediately();
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/RenderTargetStates.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "shaders/terrain_params.h"
+#include "VirtualHeightmap.hpp"
+
+// Storage of the generated terrain maps, shaders decode both the same way
+enum class TerrainTextureEncoding
+{
+  Precise, // R32F heights, RG16 snorm octahedral normals
+  Compact, // R16 unorm heights, RG8 snorm octahedral normals
+};
+
+// Conservative range of terrain heights above TERRAIN_ORIGIN_Y
+struct TerrainHeightRange
+{
+  float min;
+  float max;
+};
+
+// First cell of a level of the min/max height pyramid, same as boundsLevelOffset in the shaders
+constexpr std::uint32_t bounds_level_offset(std::uint32_t level)
+{
+  std::uint32_t offset = 0;
+  for (std::uint32_t i = 0; i < level; ++i)
+    offset += (TERRAIN_BOUNDS_BASE_SIZE >> i) * (TERRAIN_BOUNDS_BASE_SIZE >> i);
+  return offset;
+}
+
+enum class TerrainRenderMode
+{
+  Tessellation, // culled patches tessellated by distance
+  Cdlod,        // CPU selected quadtree nodes of one shared grid, no tessellation shaders
+  StreamedCdlod, // CDLOD over streamed heightmap pages, terrain space is unbounded
+};
+
+/**
+ * Procedural terrain shared by the samples. The constants buffer holds
+ * {mat4 viewProj; vec4 camView; int enableTessellation} and the application's
+ * uniform params start with the members of TerrainAppParams.
+ */
+class TerrainRenderer
+{
+public:
+  void allocateResources(
+    etna::Buffer&  in_constants,
+    etna::Buffer&  in_uniform_params_buffer,
+    etna::Sampler& in_default_sampler);
+  void loadShaders();
+  void setupPipelines(vk::Format swapchain_format);
+  // Changed parameters start a regeneration of the terrain maps
+  void update(const PerlinParams& params);
+  // Records the next slice of a pending terrain regeneration, the finished maps
+  // replace the displayed ones only once every tile is done. Also generates streamed pages
+  void updateTerrainMaps(vk::CommandBuffer cmd_buf);
+  // Picks the CDLOD nodes drawn this frame, does nothing in the tessellation mode
+  void selectNodes(glm::vec3 camera_pos, const glm::mat4& view_proj);
+  // Culls terrain patches against the view before tessellation, must be recorded outside of rendering
+  void cullPatches(vk::CommandBuffer cmd_buf);
+  void render(vk::CommandBuffer cmd_buf);
+  void regenerateTerrain();
+
+  // Displayed maps, a different image once a regeneration completes
+  const etna::Image&  getPerlinTerrainImage() const { return heightImages[frontImages]; }
+  const PerlinParams& getPerlinParams      () const { return perlinParams;             }
+
+  std::uint32_t getTerrainTextureSizeWidth () const { return terrainTextureSizeWidth;  }
+  std::uint32_t getTerrainTextureSizeHeight() const { return terrainTextureSizeHeight; }
+  float         getTerrainWorldSize        () const { return static_cast<float>
+  /**/                                     (TERRAIN_GRID_COUNT  * TERRAIN_SQUARE_SIZE);}
+
+  // Min/max height pyramid of the displayed heightmap, rebuilt with every regeneration
+  const etna::Buffer& getHeightBoundsBuffer() const { return heightBoundsBuffers[frontImages]; }
+  // Heights over a world-space xz rectangle, from a CPU copy of the coarse pyramid levels.
+  // The copy lags a regeneration by a few frames, until the first one arrives the full range is returned
+  TerrainHeightRange queryHeightRange(glm::vec2 world_min_xz, glm::vec2 world_max_xz) const;
+
+  // A few frames late, read back for statistics only
+  std::uint32_t getVisiblePatchCount() const { return visiblePatchCount; }
+  std::uint32_t getPatchCount       () const { return TERRAIN_GRID_COUNT * TERRAIN_GRID_COUNT; }
+  bool getPatchCulling() const { return enablePatchCulling; }
+  void setPatchCulling(bool enable) { enablePatchCulling = enable; }
+
+  TerrainRenderMode getRenderMode() const { return renderMode; }
+  void setRenderMode(TerrainRenderMode mode) { renderMode = mode; }
+  // Distance covered by the finest CDLOD level, every coarser level covers twice the previous one
+  float getCdlodDetailDistance() const { return cdlodDetailDistance; }
+  void  setCdlodDetailDistance(float distance) { cdlodDetailDistance = std::max(distance, 2.0f * float(TERRAIN_CDLOD_LEAF_SIZE)); }
+  std::uint32_t getCdlodNodeCount() const { return cdlodFullNodeCount + cdlodQuarterNodeCount; }
+  const VirtualHeightmap& getVirtualHeightmap() const { return virtualHeightmap; }
+  VirtualHeightmap&       getVirtualHeightmap()       { return virtualHeightmap; }
+
+  bool  isRegenerating        () const { return regenerationActive; }
+  // Whether the last immediate regeneration was served by the on-disk cache
+  bool  isLoadedFromCache     () const { return loadedFromCache; }
+  // Fraction of the current regeneration that has been recorded
+  float getRegenerationProgress() const;
+  std::uint32_t getRegenerationTilesPerFrame() const { return regenerationTilesPerFrame; }
+  void setRegenerationTilesPerFrame(std::uint32_t tiles) { regenerationTilesPerFrame = std::max(tiles, 1u); }
+
+  TerrainTextureEncoding getTextureEncoding() const { return textureEncoding; }
+  // Recreates and regenerates the terrain maps, waits for the GPU to go idle
+  void setTextureEncoding(TerrainTextureEncoding encoding);
+
+  // GPU memory of the terrain maps, for the memory report
+  std::size_t getHeightMapBytes() const;
+  std::size_t getNormalMapBytes() const;
+  // Everything the terrain holds on the GPU: both map pairs, bounds, culling and streamed pages
+  std::size_t getMemoryBytes() const;
+
+  // Recreate and regenerate the terrain maps, wait for the GPU to go idle
+  void setTerrainTextureSizeWidth (std::uint32_t w);
+  void setTerrainTextureSizeHeight(std::uint32_t h);
+
+private:
+  void createTerrainImages();
+  // Recreates the maps at a new size and regenerates them, waits for the GPU to go idle
+  void resizeTerrainImages(std::uint32_t width, std::uint32_t height);
+  // Records up to tile_budget tiles of the regeneration into the back maps
+  void recordRegeneration(vk::CommandBuffer cmd_buf, std::uint32_t tile_budget);
+  // Runs a whole regeneration right away, for startup and resource changes.
+  // Maps of parameters seen before are uploaded from the on-disk cache instead
+  void regenerateImmediately();
+  // Bounds pyramid and display states of freshly filled back maps, which then become the front ones
+  void finishRegeneration(vk::CommandBuffer cmd_buf);
+  void recordDisplayStates(vk::CommandBuffer cmd_buf, std::uint32_t images);
+  void renderCdlod(vk::CommandBuffer cmd_buf);
+  // Builds the min/max pyramid of a heightmap and queues its CPU copy
+  void recordHeightBounds(vk::CommandBuffer cmd_buf, const etna::Image& height_image, const etna::Buffer& bounds_buffer);
+
+public:
+  static constexpr std::uint32_t TERRAIN_GRID_SIZE   = 1024;
+
+private:
+  // Terrain constants
+  static constexpr std::uint32_t TERRAIN_SQUARE_SIZE = 32;
+  static constexpr std::uint32_t TERRAIN_GRID_COUNT  = TERRAIN_GRID_SIZE / TERRAIN_SQUARE_SIZE;
+
+  // Terrain parameters
+  std::uint32_t terrainTextureSizeWidth  = 4096;
+  std::uint32_t terrainTextureSizeHeight = 4096;
+  TerrainTextureEncoding textureEncoding = TerrainTextureEncoding::Compact;
+
+  // Images and textures
+  // Height and normal maps are double buffered, a regeneration fills the back pair
+  // tile by tile over several frames while the front pair stays on screen
+  std::array<etna::Image, 2> heightImages;
+  std::array<etna::Image, 2> normalImages;
+  std::uint32_t frontImages = 0;
+
+  // Min/max height pyramids, double buffered along with the maps. The CPU copy starts at
+  // a level with cells of a few world units, finer queries are not worth the readback
+  static constexpr std::uint32_t CPU_BOUNDS_FIRST_LEVEL = 2;
+  static constexpr std::uint32_t CPU_BOUNDS_CELLS =
+    bounds_level_offset(TERRAIN_BOUNDS_LEVELS) - bounds_level_offset(CPU_BOUNDS_FIRST_LEVEL);
+  std::array<etna::Buffer, 2> heightBoundsBuffers;
+  etna::Buffer heightBoundsReadback;
+  void* heightBoundsReadbackMapping = nullptr;
+  std::uint32_t heightBoundsReadbackFrames = 0;
+  std::vector<glm::vec2> cpuHeightBounds;
+  etna::Buffer visiblePatchBuffer;
+  etna::Buffer patchDrawArgsBuffer;
+  etna::Buffer patchStatsBuffer;
+  void* patchStatsMapping = nullptr;
+  std::uint32_t visiblePatchCount = 0;
+  bool enablePatchCulling = true;
+
+  // CDLOD nodes of the last few frames, a section per frame in flight.
+  // Whole nodes come first, then quarters of nodes whose other children are finer
+  static constexpr std::uint32_t MAX_CDLOD_NODES = 2048;
+  static constexpr std::uint32_t FRAME_RING = 3;
+  TerrainRenderMode renderMode = TerrainRenderMode::Tessellation;
+  float cdlodDetailDistance = 32.0f;
+  etna::Buffer cdlodNodeBuffer;
+  void* cdlodNodeMapping = nullptr;
+  std::vector<TerrainCdlodNode> cdlodFullNodes;
+  std::vector<TerrainCdlodNode> cdlodQuarterNodes;
+  std::uint32_t cdlodFullNodeCount = 0;
+  std::uint32_t cdlodQuarterNodeCount = 0;
+  std::uint32_t cdlodFrameSection = 0;
+  VirtualHeightmap virtualHeightmap;
+
+  // Regeneration: one fused height and normal dispatch per tile
+  static constexpr std::uint32_t REGENERATION_TILE_SIZE = 512;
+  std::uint32_t regenerationTilesPerFrame = 16;
+  PerlinParams regenerationParams{};
+  std::uint32_t regenerationStep = 0;
+  bool regenerationActive = false;
+  bool regenerationRequested = false;
+  bool loadedFromCache = false;
+
+  // Pipelines
+  // Indexed by TerrainTextureEncoding, storage image formats are fixed per shader
+  std::array<etna::ComputePipeline, 2> generatePipelines{};
+  etna::ComputePipeline  boundsBasePipeline{};
+  etna::ComputePipeline  boundsReducePipeline{};
+  etna::ComputePipeline  patchCullPipeline{};
+  etna::GraphicsPipeline terrainPipeline{};
+  etna::GraphicsPipeline terrainCdlodPipeline{};
+  etna::GraphicsPipeline terrainCdlodStreamedPipeline{};
+
+  PerlinParams perlinParams{
+    .octaves = 10u,
+    .amplitude = 0.5f,
+    .frequencyMultiplier = 2.0f,
+    .scale = 8.0f,
+    .time = 0.0f,
+  };
+
+  // References to shared buffers
+  etna::Buffer*  constants             = nullptr;
+  etna::Buffer*  uniform_params_buffer = nullptr;
+  etna::Sampler* default_sampler       = nullptr;
+};
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "VirtualHeightmap.hpp"
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <cstring>
+
+namespace
+{
+
+struct PagePushConstants
+{
+  glm::ivec2 page;
+  glm::uvec2 slotOffset;
+  PerlinParams params;
+};
+
+} // namespace
+
+void VirtualHeightmap::allocateResources()
+{
+  auto& ctx = etna::get_context();
+
+  pageAtlas = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{ATLAS_SIZE, ATLAS_SIZE, 1},
+    .name = "terrain_page_atlas",
+    .format = vk::Format::eR16Unorm,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+  });
+
+  pageTableBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * WINDOW_ENTRIES * FRAME_RING,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "terrain_page_table",
+  });
+  pageTableMapping = pageTableBuffer.map();
+
+  pageSlots.assign(POOL_SLOTS, PageSlot{});
+  invalidatePages();
+}
+
+void VirtualHeightmap::loadShaders()
+{
+  etna::create_program("terrain_page", {TERRAIN_SHADERS_ROOT "terrain_page.comp.spv"});
+}
+
+void VirtualHeightmap::setupPipelines()
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  pagePipeline = pipelineManager.createComputePipeline("terrain_page", {});
+}
+
+std::size_t VirtualHeightmap::getMemoryBytes() const
+{
+  // R16 atlas and the indirection table sections
+  return std::size_t{ATLAS_SIZE} * ATLAS_SIZE * 2 + sizeof(std::uint32_t) * WINDOW_ENTRIES * FRAME_RING;
+}
+
+std::uint64_t VirtualHeightmap::pageKey(glm::ivec2 page)
+{
+  return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(page.x)) << 32) |
+    static_cast<std::uint32_t>(page.y);
+}
+
+void VirtualHeightmap::invalidatePages()
+{
+  pageLookup.clear();
+  freePageSlots.clear();
+  for (std::uint32_t slot = POOL_SLOTS; slot-- > 0;)
+  {
+    pageSlots[slot] = PageSlot{};
+    freePageSlots.push_back(slot);
+  }
+}
+
+std::uint32_t VirtualHeightmap::acquirePageSlot()
+{
+  if (!freePageSlots.empty())
+  {
+    const std::uint32_t slot = freePageSlots.back();
+    freePageSlots.pop_back();
+    return slot;
+  }
+
+  std::uint32_t victim = 0;
+  for (std::uint32_t slot = 1; slot < POOL_SLOTS; ++slot)
+    if (pageSlots[slot].lastUsedFrame < pageSlots[victim].lastUsedFrame)
+      victim = slot;
+  if (pageSlots[victim].lastUsedFrame == frameIndex)
+    return NO_SLOT;
+
+  pageLookup.erase(pageKey(pageSlots[victim].page));
+  return victim;
+}
+
+void VirtualHeightmap::update(glm::vec2 camera_terrain_pos, const PerlinParams& params)
+{
+  ++frameIndex;
+  pageRequests.clear();
+  pendingPageCount = 0;
+
+  if (!pageParamsValid || std::memcmp(&params, &pageParams, sizeof(PerlinParams)) != 0)
+  {
+    invalidatePages();
+    pageParams = params;
+    pageParamsValid = true;
+  }
+
+  const float pageSize = static_cast<float>(TERRAIN_PAGE_SIZE);
+  const glm::ivec2 cameraPage(glm::floor(camera_terrain_pos / pageSize));
+  windowOrigin = cameraPage - static_cast<int>(TERRAIN_PAGE_WINDOW / 2);
+
+  struct NeededPage
+  {
+    glm::ivec2 page;
+    float distance;
+  };
+  std::vector<NeededPage> neededPages;
+  const glm::ivec2 minPage(glm::floor((camera_terrain_pos - STREAM_RADIUS) / pageSize));
+  const glm::ivec2 maxPage(glm::floor((camera_terrain_pos + STREAM_RADIUS) / pageSize));
+  for (int y = minPage.y; y <= maxPage.y; ++y)
+    for (int x = minPage.x; x <= maxPage.x; ++x)
+    {
+      const glm::vec2 pageMin = glm::vec2(x, y) * pageSize;
+      const glm::vec2 closest = glm::clamp(camera_terrain_pos, pageMin, pageMin + pageSize);
+      const float distance = glm::distance(closest, camera_terrain_pos);
+      if (distance <= STREAM_RADIUS)
+        neededPages.push_back(NeededPage{{x, y}, distance});
+    }
+
+  std::sort(neededPages.begin(), neededPages.end(), [](const NeededPage& a, const NeededPage& b) {
+    return a.distance < b.distance;
+  });
+
+  // An empty pool is filled at once, afterwards pages trickle in as the camera moves
+  const std::size_t budget = pageLookup.empty() ? POOL_SLOTS : pagesPerFrame;
+  for (const NeededPage& needed : neededPages)
+  {
+    if (auto it = pageLookup.find(pageKey(needed.page)); it != pageLookup.end())
+    {
+      pageSlots[it->second].lastUsedFrame = frameIndex;
+      continue;
+    }
+
+    const std::uint32_t slot = pageRequests.size() < budget ? acquirePageSlot() : NO_SLOT;
+    if (slot == NO_SLOT)
+    {
+      ++pendingPageCount;
+      continue;
+    }
+    pageSlots[slot] = PageSlot{.page = needed.page, .lastUsedFrame = frameIndex};
+    pageLookup.emplace(pageKey(needed.page), slot);
+    pageRequests.push_back(PageRequest{needed.page, slot});
+  }
+
+  pageTable.assign(WINDOW_ENTRIES, 0);
+  for (const auto& [key, slot] : pageLookup)
+  {
+    const glm::ivec2 window = pageSlots[slot].page - windowOrigin;
+    if (window.x < 0 || window.y < 0 || window.x >= TERRAIN_PAGE_WINDOW || window.y >= TERRAIN_PAGE_WINDOW)
+      continue;
+    pageTable[window.y * TERRAIN_PAGE_WINDOW + window.x] = slot + 1;
+  }
+
+  frameSection = (frameSection + 1) % FRAME_RING;
+  std::memcpy(
+    static_cast<std::uint32_t*>(pageTableMapping) + frameSection * WINDOW_ENTRIES,
+    pageTable.data(),
+    WINDOW_ENTRIES * sizeof(std::uint32_t));
+}
+
+void VirtualHeightmap::generatePages(vk::CommandBuffer cmd_buf)
+{
+  if (!pageRequests.empty())
+  {
+    etna::set_state(
+      cmd_buf,
+      pageAtlas.get(),
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderWrite,
+      vk::ImageLayout::eGeneral,
+      vk::ImageAspectFlagBits::eColor);
+    etna::flush_barriers(cmd_buf);
+
+    auto pageInfo = etna::get_shader_program("terrain_page");
+    auto set = etna::create_descriptor_set(
+      pageInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, pageAtlas.genBinding({}, vk::ImageLayout::eGeneral)},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pagePipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, pagePipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+
+    for (const PageRequest& request : pageRequests)
+    {
+      const PagePushConstants pushConstants{
+        .page = request.page,
+        .slotOffset =
+          glm::uvec2(request.slot % TERRAIN_PAGE_POOL_SIDE, request.slot / TERRAIN_PAGE_POOL_SIDE) * TERRAIN_PAGE_TEXELS,
+        .params = pageParams,
+      };
+      cmd_buf.pushConstants(
+        pagePipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+      cmd_buf.dispatch(TERRAIN_PAGE_TEXELS / 16, TERRAIN_PAGE_TEXELS / 16, 1);
+    }
+  }
+
+  etna::set_state(
+    cmd_buf,
+    pageAtlas.get(),
+    vk::PipelineStageFlagBits2::eVertexShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
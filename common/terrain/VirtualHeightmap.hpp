@@ -0,0 +1,93 @@
+#pragma once
+
+#include <etna/Image.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "shaders/terrain_params.h"
+
+/**
+ * Heights of an unbounded terrain, streamed in fixed size pages.
+ * Pages within the stream radius of the camera are generated on the GPU
+ * nearest first, a limited number per frame, into the slots of a page atlas.
+ * When the atlas is full the least recently needed page is evicted, so GPU
+ * memory stays fixed no matter how far the camera travels. Every frame the
+ * resident pages around the camera are published in an indirection table.
+ */
+class VirtualHeightmap
+{
+public:
+  static constexpr std::uint32_t POOL_SLOTS = TERRAIN_PAGE_POOL_SIDE * TERRAIN_PAGE_POOL_SIDE;
+  static constexpr std::uint32_t ATLAS_SIZE = TERRAIN_PAGE_POOL_SIDE * TERRAIN_PAGE_TEXELS;
+  static constexpr std::uint32_t WINDOW_ENTRIES = TERRAIN_PAGE_WINDOW * TERRAIN_PAGE_WINDOW;
+  // Pages needed at once have to fit into the pool
+  static constexpr float STREAM_RADIUS = 480.0f;
+
+  void allocateResources();
+  void loadShaders();
+  void setupPipelines();
+
+  // Picks the pages around the camera, queues the missing ones and publishes the indirection table.
+  // New parameters make every page stale
+  void update(glm::vec2 camera_terrain_pos, const PerlinParams& params);
+  // Records the generation of the pages queued by update, must be recorded outside of rendering
+  void generatePages(vk::CommandBuffer cmd_buf);
+
+  const etna::Image&  getPageAtlas     () const { return pageAtlas;      }
+  const etna::Buffer& getPageTable     () const { return pageTableBuffer; }
+  std::uint32_t       getPageTableOffset() const { return frameSection * WINDOW_ENTRIES; }
+  glm::ivec2          getWindowOrigin  () const { return windowOrigin;   }
+
+  std::uint32_t getResidentPageCount() const { return static_cast<std::uint32_t>(pageLookup.size()); }
+  std::uint32_t getPendingPageCount () const { return pendingPageCount; }
+  std::uint32_t getPagesPerFrame    () const { return pagesPerFrame;    }
+  void setPagesPerFrame(std::uint32_t pages) { pagesPerFrame = std::max(pages, 1u); }
+  std::size_t   getMemoryBytes      () const;
+
+private:
+  struct PageSlot
+  {
+    glm::ivec2 page;
+    std::uint64_t lastUsedFrame = 0;
+  };
+
+  struct PageRequest
+  {
+    glm::ivec2 page;
+    std::uint32_t slot;
+  };
+
+  void invalidatePages();
+  // NO_SLOT if every page is needed this frame
+  std::uint32_t acquirePageSlot();
+  static std::uint64_t pageKey(glm::ivec2 page);
+
+private:
+  static constexpr std::uint32_t FRAME_RING = 3;
+  static constexpr std::uint32_t NO_SLOT = ~0u;
+
+  etna::Image pageAtlas;
+  etna::Buffer pageTableBuffer;
+  void* pageTableMapping = nullptr;
+  etna::ComputePipeline pagePipeline{};
+
+  std::vector<PageSlot> pageSlots;
+  std::vector<std::uint32_t> freePageSlots;
+  std::unordered_map<std::uint64_t, std::uint32_t> pageLookup;
+  std::vector<PageRequest> pageRequests;
+  std::vector<std::uint32_t> pageTable;
+
+  PerlinParams pageParams{};
+  bool pageParamsValid = false;
+  std::uint64_t frameIndex = 0;
+  std::uint32_t frameSection = 0;
+  glm::ivec2 windowOrigin{0, 0};
+  std::uint32_t pagesPerFrame = 16;
+  std::uint32_t pendingPageCount = 0;
+};
@@ -0,0 +1,29 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "terrain_params.h"
+#include "texture_encoding.glsl"
+#include "terrain_shading.glsl"
+
+layout(location = 0) out vec4 out_fragColor;
+layout(binding = 1) uniform sampler2D normalMapTerrainImage;
+
+layout(binding = 3, set = 0) uniform AppData
+{
+  TerrainAppParams params;
+};
+
+layout(location = 0) in VS_OUT
+{
+  vec3 wPos;
+  vec2 texCoord;
+} surf;
+
+void main()
+{
+  const vec3 wNorm = decode_octahedral(texture(normalMapTerrainImage, surf.texCoord).xy);
+
+  out_fragColor.rgb = shadeTerrain(surf.wPos, wNorm, params.baseColor);
+  out_fragColor.a = 1.0f;
+}
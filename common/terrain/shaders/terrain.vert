@@ -0,0 +1,15 @@
+#version 450
+
+layout(location = 0) out uint InstanceIndex;
+
+// Patches that survived terrain_patch_cull.comp
+layout(binding = 4, std430) readonly buffer VisiblePatches
+{
+  uint patches[];
+} visiblePatches;
+
+void main()
+{
+    InstanceIndex = visiblePatches.patches[gl_InstanceIndex];
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+}
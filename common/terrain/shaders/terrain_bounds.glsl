@@ -0,0 +1,18 @@
+#ifndef TERRAIN_BOUNDS_GLSL_INCLUDED
+#define TERRAIN_BOUNDS_GLSL_INCLUDED
+
+#include "terrain_params.h"
+
+// First cell of a level of the height bounds pyramid
+uint boundsLevelOffset(uint level)
+{
+  uint offset = 0u;
+  for (uint i = 0u; i < level; ++i)
+  {
+    uint size = uint(TERRAIN_BOUNDS_BASE_SIZE) >> i;
+    offset += size * size;
+  }
+  return offset;
+}
+
+#endif // TERRAIN_BOUNDS_GLSL_INCLUDED
@@ -0,0 +1,136 @@
+#ifndef TERRAIN_CDLOD_GLSL_INCLUDED
+#define TERRAIN_CDLOD_GLSL_INCLUDED
+
+// NOTE: shared body of terrain_cdlod*.vert, TERRAIN_CDLOD_STREAMED samples the streamed pages
+// instead of the heightmap and computes normals from them
+
+#include "terrain_params.h"
+#include "texture_encoding.glsl"
+
+layout(std140, set = 0, binding = 2) uniform Constants
+{
+  mat4 viewProj;
+  vec4 camView;
+  int enableTessellation;
+} constants;
+
+// Nodes selected on the CPU, one instance each
+layout(binding = 4, std430) readonly buffer Nodes
+{
+  TerrainCdlodNode nodes[];
+};
+
+#ifdef TERRAIN_CDLOD_STREAMED
+layout(binding = 0) uniform sampler2D pageAtlas;
+
+layout(binding = 5, std430) readonly buffer PageTable
+{
+  uint pageTable[];
+};
+
+layout(push_constant) uniform PushConstants
+{
+  // Quads per node side, quarters of a node are drawn with half the grid
+  uint gridQuads;
+  // Section of the page table written for this frame
+  uint pageTableOffset;
+  // Page at the corner of the page table window
+  ivec2 windowOrigin;
+} pc;
+#else
+layout(binding = 0) uniform sampler2D perlinNoise;
+
+layout(push_constant) uniform PushConstants
+{
+  // Quads per node side, quarters of a node are drawn with half the grid
+  uint gridQuads;
+} pc;
+#endif
+
+layout(location = 0) out VS_OUT
+{
+  vec3 wPos;
+  vec2 texCoord;
+#ifdef TERRAIN_CDLOD_STREAMED
+  vec3 wNorm;
+#endif
+};
+
+out gl_PerVertex
+{
+  vec4 gl_Position;
+};
+
+const float terrainSize = TERRAIN_PATCH_GRID * TERRAIN_PATCH_SIZE;
+
+// Two triangles per quad, wound like the quads of the tessellated patches
+const uvec2 quadCorners[6] = uvec2[6](uvec2(0, 0), uvec2(0, 1), uvec2(1, 0), uvec2(1, 0), uvec2(0, 1), uvec2(1, 1));
+
+#ifdef TERRAIN_CDLOD_STREAMED
+float sampleHeight(vec2 terrainPos)
+{
+  vec2 pagePos = terrainPos / TERRAIN_PAGE_SIZE;
+  ivec2 page = ivec2(floor(pagePos));
+  ivec2 window = page - pc.windowOrigin;
+  if (any(lessThan(window, ivec2(0))) || any(greaterThanEqual(window, ivec2(TERRAIN_PAGE_WINDOW))))
+    return 0.5 * (TERRAIN_HEIGHT_MIN + TERRAIN_HEIGHT_MAX) * TERRAIN_HEIGHT_SCALE;
+
+  // Pages still being generated are flat until they arrive
+  uint entry = pageTable[pc.pageTableOffset + uint(window.y * TERRAIN_PAGE_WINDOW + window.x)];
+  if (entry == 0u)
+    return 0.5 * (TERRAIN_HEIGHT_MIN + TERRAIN_HEIGHT_MAX) * TERRAIN_HEIGHT_SCALE;
+
+  uint slot = entry - 1u;
+  vec2 slotOffset = vec2(slot % TERRAIN_PAGE_POOL_SIDE, slot / TERRAIN_PAGE_POOL_SIDE) * TERRAIN_PAGE_TEXELS;
+  vec2 texel = slotOffset + 0.5 + (pagePos - vec2(page)) * float(TERRAIN_PAGE_TEXELS - 1);
+  float stored = textureLod(pageAtlas, texel / float(TERRAIN_PAGE_POOL_SIDE * TERRAIN_PAGE_TEXELS), 0.0).x;
+  return decode_unorm_range(stored, TERRAIN_HEIGHT_MIN, TERRAIN_HEIGHT_MAX) * TERRAIN_HEIGHT_SCALE;
+}
+#else
+float sampleHeight(vec2 terrainPos)
+{
+  float stored = textureLod(perlinNoise, terrainPos / terrainSize, 0.0).x;
+  return decode_unorm_range(stored, TERRAIN_HEIGHT_MIN, TERRAIN_HEIGHT_MAX) * TERRAIN_HEIGHT_SCALE;
+}
+#endif
+
+vec3 toWorld(vec2 terrainPos, float height)
+{
+  // Texture rows run against world z
+  return vec3(
+    TERRAIN_ORIGIN_X + terrainPos.x,
+    TERRAIN_ORIGIN_Y + height,
+    TERRAIN_ORIGIN_Z + terrainSize - terrainPos.y);
+}
+
+void main()
+{
+  TerrainCdlodNode node = nodes[gl_InstanceIndex];
+
+  uint quad = uint(gl_VertexIndex) / 6u;
+  uvec2 gridPos = uvec2(quad % pc.gridQuads, quad / pc.gridQuads) + quadCorners[uint(gl_VertexIndex) % 6u];
+  float cellSize = node.size / float(pc.gridQuads);
+  vec2 terrainPos = vec2(node.offsetU, node.offsetV) + vec2(gridPos) * cellSize;
+
+  // Odd vertices slide onto their even neighbours, at the far end of the node's
+  // range the grid matches the one of the next coarser level exactly
+  float dist = distance(toWorld(terrainPos, sampleHeight(terrainPos)), constants.camView.xyz);
+  float morph = clamp((dist - node.morphStart) / (node.morphEnd - node.morphStart), 0.0, 1.0);
+  terrainPos -= vec2(gridPos & 1u) * cellSize * morph;
+
+  texCoord = terrainPos / terrainSize;
+  wPos = toWorld(terrainPos, sampleHeight(terrainPos));
+  gl_Position = constants.viewProj * vec4(wPos, 1.0);
+
+#ifdef TERRAIN_CDLOD_STREAMED
+  // There is no normal map for the pages, differences over one grid cell match the drawn detail
+  float left  = sampleHeight(terrainPos - vec2(cellSize, 0.0));
+  float right = sampleHeight(terrainPos + vec2(cellSize, 0.0));
+  float down  = sampleHeight(terrainPos - vec2(0.0, cellSize));
+  float up    = sampleHeight(terrainPos + vec2(0.0, cellSize));
+  // Terrain space v is world -z
+  wNorm = normalize(vec3(left - right, 2.0 * cellSize, up - down));
+#endif
+}
+
+#endif // TERRAIN_CDLOD_GLSL_INCLUDED
@@ -0,0 +1,7 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+// Heights from the streamed page atlas, terrain space is unbounded
+#define TERRAIN_CDLOD_STREAMED
+#include "terrain_cdlod.glsl"
@@ -0,0 +1,65 @@
+#ifndef TERRAIN_GENERATE_GLSL_INCLUDED
+#define TERRAIN_GENERATE_GLSL_INCLUDED
+
+// NOTE: shared body of terrain_generate*.comp, TERRAIN_HEIGHT_FORMAT and TERRAIN_NORMAL_FORMAT
+// pick the storage encodings
+
+#include "terrain_params.h"
+#include "texture_encoding.glsl"
+#include "terrain_noise.glsl"
+
+layout(local_size_x = TERRAIN_GENERATE_GROUP_SIZE, local_size_y = TERRAIN_GENERATE_GROUP_SIZE) in;
+layout(binding = 0, TERRAIN_HEIGHT_FORMAT) restrict writeonly uniform image2D heightImage;
+layout(binding = 1, TERRAIN_NORMAL_FORMAT) restrict writeonly uniform image2D normalImage;
+// Parameters and the tile are pushed per dispatch, regeneration is spread over several frames
+layout(push_constant) uniform PerlinParamsPush {
+  uvec2 tileOffset;
+  int octaves;
+  float amplitude;
+  float frequencyMultiplier;
+  float scale;
+  float time;
+} perlinParams;
+
+// Heights of the workgroup's texels and their neighbours, so normals never read back the heightmap
+const uint apronSide = TERRAIN_GENERATE_GROUP_SIZE + 2;
+shared float heights[apronSide * apronSide];
+
+// Horizontal texel spacing the normals are derived with
+const float pixelSize = 30.0;
+
+float sharedHeight(uvec2 apronTexel)
+{
+  return heights[apronTexel.y * apronSide + apronTexel.x] * TERRAIN_HEIGHT_SCALE;
+}
+
+void main() {
+  ivec2 size = imageSize(heightImage);
+  ivec2 apronOrigin = ivec2(perlinParams.tileOffset + gl_WorkGroupID.xy * TERRAIN_GENERATE_GROUP_SIZE) - 1;
+
+  // Apron texels past the map edges are evaluated too, the noise continues there
+  for (uint i = gl_LocalInvocationIndex; i < apronSide * apronSide; i += TERRAIN_GENERATE_GROUP_SIZE * TERRAIN_GENERATE_GROUP_SIZE)
+  {
+    ivec2 texel = apronOrigin + ivec2(i % apronSide, i / apronSide);
+    vec2 st = vec2(texel) / vec2(size);
+    heights[i] = terrainHeight(
+      st, perlinParams.octaves, perlinParams.amplitude, perlinParams.frequencyMultiplier, perlinParams.scale);
+  }
+  barrier();
+
+  ivec2 idxy = ivec2(perlinParams.tileOffset + gl_GlobalInvocationID.xy);
+  if (idxy.x >= size.x || idxy.y >= size.y) return;
+
+  uvec2 center = gl_LocalInvocationID.xy + 1u;
+  float height = heights[center.y * apronSide + center.x];
+  imageStore(heightImage, idxy, vec4(encode_unorm_range(height, TERRAIN_HEIGHT_MIN, TERRAIN_HEIGHT_MAX)));
+
+  float left  = sharedHeight(center + uvec2(1, 0));
+  float right = sharedHeight(center - uvec2(1, 0));
+  float up    = sharedHeight(center + uvec2(0, 1));
+  float down  = sharedHeight(center - uvec2(0, 1));
+  vec3 normal = normalize(vec3(right - left, 2.0 * pixelSize, up - down));
+  imageStore(normalImage, idxy, vec4(encode_octahedral(normal), 0.0, 0.0));
+}
+
+#endif // TERRAIN_GENERATE_GLSL_INCLUDED
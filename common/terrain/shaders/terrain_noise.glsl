@@ -0,0 +1,65 @@
+#ifndef TERRAIN_NOISE_GLSL_INCLUDED
+#define TERRAIN_NOISE_GLSL_INCLUDED
+
+// NOTE: terrain heights as a function of terrain space, shared by the heightmap and the streamed pages.
+// common/noise/TerrainNoise.cpp mirrors it operation by operation, keep them in sync
+
+// Integer lattice hash, unlike sin based ones it gives the same bits on every GPU and in
+// common/noise/TerrainNoise.cpp. The top 24 bits convert to float exactly
+vec2 hash22(ivec2 cell) {
+  uvec2 v = uvec2(cell) * 1664525u + 1013904223u;
+  v.x += v.y * 1664525u;
+  v.y += v.x * 1664525u;
+  v ^= v >> 16u;
+  v.x += v.y * 1664525u;
+  v.y += v.x * 1664525u;
+  v ^= v >> 16u;
+  return vec2(v >> 8u) * (2.0 / 16777216.0) - 1.0;
+}
+
+vec2 quintic(vec2 t) {
+  return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+float gradientNoise(vec2 p) {
+  vec2 i = floor(p);
+  vec2 f = p - i;
+  ivec2 cell = ivec2(i);
+
+  vec2 g00 = hash22(cell + ivec2(0, 0));
+  vec2 g10 = hash22(cell + ivec2(1, 0));
+  vec2 g01 = hash22(cell + ivec2(0, 1));
+  vec2 g11 = hash22(cell + ivec2(1, 1));
+
+  float n00 = dot(g00, f - vec2(0.0, 0.0));
+  float n10 = dot(g10, f - vec2(1.0, 0.0));
+  float n01 = dot(g01, f - vec2(0.0, 1.0));
+  float n11 = dot(g11, f - vec2(1.0, 1.0));
+
+  vec2 u = quintic(f);
+
+  return mix(mix(n00, n10, u.x), mix(n01, n11, u.x), u.y);
+}
+
+float fbm(vec2 p, int octaves, float amplitude, float frequencyMultiplier) {
+  float value = 0.0;
+  float frequency = 1.0;
+  float maxValue = 0.0;
+
+  for (int i = 0; i < octaves; i++) {
+    value += amplitude * gradientNoise(p * frequency);
+    maxValue += amplitude;
+    amplitude *= 0.5;
+    frequency *= frequencyMultiplier;
+  }
+
+  return value / maxValue;
+}
+
+// Height before encoding, st is terrain space divided by the terrain size
+float terrainHeight(vec2 st, int octaves, float amplitude, float frequencyMultiplier, float scale) {
+  float noise = fbm(st * scale, octaves, amplitude, frequencyMultiplier) * 0.5 + 0.5;
+  return noise + 0.5;
+}
+
+#endif // TERRAIN_NOISE_GLSL_INCLUDED
@@ -0,0 +1,77 @@
+#ifndef TERRAIN_PARAMS_H_INCLUDED
+#define TERRAIN_PARAMS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+// Heightmap texels hold heights in [TERRAIN_HEIGHT_MIN, TERRAIN_HEIGHT_MAX] remapped to [0, 1],
+// so the 16-bit unorm encoding keeps its full range
+#define TERRAIN_HEIGHT_MIN 0.5
+#define TERRAIN_HEIGHT_MAX 1.5
+
+// Heights and normals are generated in one pass, every workgroup also evaluates a one texel apron
+#define TERRAIN_GENERATE_GROUP_SIZE 16
+
+// Terrain is drawn as TERRAIN_PATCH_GRID^2 tessellated patches, culled by terrain_patch_cull.comp
+// against their height bounds first
+#define TERRAIN_PATCH_GRID     32
+#define TERRAIN_PATCH_SIZE     32.0
+#define TERRAIN_ORIGIN_X       -500.0
+#define TERRAIN_ORIGIN_Y       -300.0
+#define TERRAIN_ORIGIN_Z       -500.0
+#define TERRAIN_HEIGHT_SCALE   200.0
+#define TERRAIN_CULL_WORKGROUP_SIZE 64
+
+// Min/max height pyramid of the heightmap, levels are stored one after another in a buffer, finest first.
+// Level 0 has TERRAIN_BOUNDS_BASE_SIZE^2 cells, the level with TERRAIN_PATCH_GRID^2 cells bounds the patches
+#define TERRAIN_BOUNDS_BASE_SIZE      256
+#define TERRAIN_BOUNDS_LEVELS         9
+#define TERRAIN_BOUNDS_PATCH_LEVEL    3
+#define TERRAIN_BOUNDS_WORKGROUP_SIZE 64
+
+// CDLOD terrain without tessellation: quadtree nodes from TERRAIN_CDLOD_LEAF_SIZE up to the whole
+// terrain share one grid of TERRAIN_CDLOD_GRID^2 quads, vertices morph into the next coarser level
+#define TERRAIN_CDLOD_GRID      32
+#define TERRAIN_CDLOD_LEAF_SIZE 8.0
+#define TERRAIN_CDLOD_LEVELS    8
+
+// Streamed terrain: terrain space is split into pages of TERRAIN_PAGE_SIZE units, generated on demand
+// into the slots of a TERRAIN_PAGE_POOL_SIDE^2 atlas. Neighbouring pages share their edge texels,
+// so filtering never crosses a slot. Pages around the camera are found through an indirection
+// table of TERRAIN_PAGE_WINDOW^2 entries, slot + 1 or 0 for pages that are not resident yet
+#define TERRAIN_PAGE_TEXELS    256
+#define TERRAIN_PAGE_SIZE      64.0
+#define TERRAIN_PAGE_POOL_SIDE 16
+#define TERRAIN_PAGE_WINDOW    32
+
+struct PerlinParams
+{
+  shader_uint octaves;
+  shader_float amplitude;
+  shader_float frequencyMultiplier;
+  shader_float scale;
+  shader_float time;
+};
+
+// Quadtree node drawn by the CDLOD terrain, in terrain space: texture coordinates times the terrain size
+struct TerrainCdlodNode
+{
+  shader_float offsetU;
+  shader_float offsetV;
+  shader_float size;
+  shader_float morphStart; // camera distance where vertices start to morph into the coarser level
+  shader_float morphEnd;   // and where they are fully morphed
+  shader_uint pad0;
+  shader_uint pad1;
+  shader_uint pad2;
+};
+
+// Leading members of the application's UniformParams, the only ones the terrain shaders read
+struct TerrainAppParams
+{
+  shader_mat4 lightMatrix;
+  shader_vec3 lightPos;
+  shader_float time;
+  shader_vec3 baseColor;
+};
+
+#endif // TERRAIN_PARAMS_H_INCLUDED
@@ -0,0 +1,22 @@
+#ifndef TERRAIN_SHADING_GLSL_INCLUDED
+#define TERRAIN_SHADING_GLSL_INCLUDED
+
+// NOTE: lighting shared by terrain.frag and terrain_streamed.frag, which only differ in where normals come from
+
+vec3 shadeTerrain(vec3 wPos, vec3 wNorm, vec3 surfaceColor)
+{
+  const vec3 wLightPos = vec3(50, 10, 255);
+  const vec3 lightColor = vec3(1.0f, 1.0f, 1.0f);
+
+  const vec3 lightDir = normalize(wLightPos - wPos);
+  const vec3 viewDir = normalize(-wPos);
+  const vec3 halfDir = normalize(lightDir + viewDir);
+
+  const vec3 diffuse = max(dot(wNorm, lightDir), 0.0f) * lightColor;
+  const vec3 specular = pow(max(dot(wNorm, halfDir), 0.0f), 128.0f) * lightColor;
+  const vec3 ambient = vec3(0.1, 0.1, 0.1);
+
+  return (diffuse + specular + ambient) * surfaceColor;
+}
+
+#endif // TERRAIN_SHADING_GLSL_INCLUDED
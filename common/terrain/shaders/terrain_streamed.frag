@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "terrain_params.h"
+#include "terrain_shading.glsl"
+
+layout(location = 0) out vec4 out_fragColor;
+
+layout(binding = 3, set = 0) uniform AppData
+{
+  TerrainAppParams params;
+};
+
+// Streamed pages have no normal map, normals come from the vertex shader
+layout(location = 0) in VS_OUT
+{
+  vec3 wPos;
+  vec2 texCoord;
+  vec3 wNorm;
+} surf;
+
+void main()
+{
+  out_fragColor.rgb = shadeTerrain(surf.wPos, normalize(surf.wNorm), params.baseColor);
+  out_fragColor.a = 1.0f;
+}
@@ -0,0 +1,245 @@
+#include "CascadedShadowMap.hpp"
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/RenderTargetStates.hpp>
+#include <etna/Profiling.hpp>
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+void CascadedShadowMap::allocateResources()
+{
+  auto& ctx = etna::get_context();
+
+  atlas = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{ATLAS_SIZE, ATLAS_SIZE, 1},
+    .name = "shadow_cascades",
+    .format = vk::Format::eD16Unorm,
+    .imageUsage =
+      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+  });
+
+  // A new atlas holds nothing
+  invalidateAll();
+}
+
+void CascadedShadowMap::loadShaders()
+{
+  etna::create_program("simple_shadow", {SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
+}
+
+void CascadedShadowMap::setupPipelines(const etna::VertexShaderInputDescription& vertex_input)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+
+  shadowPipeline = {};
+  shadowPipeline = pipelineManager.createGraphicsPipeline(
+    "simple_shadow",
+    etna::GraphicsPipeline::CreateInfo{
+      .vertexShaderInput = vertex_input,
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eBack,
+          .frontFace = vk::FrontFace::eCounterClockwise,
+          // Texels of the far cascades cover a lot, slopes need more bias there
+          .depthBiasEnable = VK_TRUE,
+          .depthBiasConstantFactor = 1.25f,
+          .depthBiasSlopeFactor = 1.75f,
+          .lineWidth = 1.f,
+        },
+      .fragmentShaderOutput =
+        {
+          .depthAttachmentFormat = vk::Format::eD16Unorm,
+        },
+    });
+}
+
+void CascadedShadowMap::update(
+  const Camera& main_cam, float aspect, const Camera& shadow_cam, const SceneBounds& scene_bounds)
+{
+  const float nearDist = main_cam.zNear;
+  const float farDist = std::max(std::min(main_cam.zFar, shadowDistance), nearDist * 2.0f);
+
+  // Practical split scheme, a blend of logarithmic and uniform splits
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    const float t = float(i + 1) / float(SHADOW_CASCADE_COUNT);
+    const float logSplit = nearDist * std::pow(farDist / nearDist, t);
+    const float uniformSplit = nearDist + (farDist - nearDist) * t;
+    splitDistances[i] = glm::mix(uniformSplit, logSplit, splitLambda);
+  }
+
+  // Light space without translation, snapping then happens on a fixed grid
+  const glm::mat4 lightRotation = glm::mat4_cast(glm::conjugate(shadow_cam.rotation));
+
+  // Casters between the light and a cascade still have to land in its depth range
+  float sceneMinZ = std::numeric_limits<float>::max();
+  for (std::uint32_t corner = 0; corner < 8; ++corner)
+  {
+    const glm::vec3 p{
+      (corner & 1) ? scene_bounds.max.x : scene_bounds.min.x,
+      (corner & 2) ? scene_bounds.max.y : scene_bounds.min.y,
+      (corner & 4) ? scene_bounds.max.z : scene_bounds.min.z};
+    sceneMinZ = std::min(sceneMinZ, (lightRotation * glm::vec4(p, 1.0f)).z);
+  }
+
+  const float tanHalfFov = std::tan(glm::radians(main_cam.fov) * 0.5f);
+  const glm::vec3 forward = main_cam.forward();
+  const glm::vec3 right = main_cam.right();
+  const glm::vec3 up = main_cam.up();
+
+  float sliceNear = nearDist;
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    const float sliceFar = splitDistances[i];
+
+    std::array<glm::vec3, 8> corners;
+    for (std::uint32_t c = 0; c < 8; ++c)
+    {
+      const float dist = (c & 4) ? sliceFar : sliceNear;
+      const float halfHeight = dist * tanHalfFov;
+      const float halfWidth = halfHeight * aspect;
+      corners[c] = main_cam.position + forward * dist
+        + right * ((c & 1) ? halfWidth : -halfWidth) + up * ((c & 2) ? halfHeight : -halfHeight);
+    }
+
+    // A bounding sphere keeps the cascade size constant while the camera turns
+    glm::vec3 center{0.0f};
+    for (const auto& corner : corners)
+      center += corner;
+    center /= float(corners.size());
+
+    float radius = 0.0f;
+    for (const auto& corner : corners)
+      radius = std::max(radius, glm::distance(corner, center));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    const glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+    const float sliceMinZ = std::min(sceneMinZ, lightCenter.z - radius);
+    const float sliceMaxZ = lightCenter.z + radius;
+    const float coverRadius =
+      std::ceil(radius * (1.0f + (enableCaching ? guardBand : 0.0f)) * 16.0f) / 16.0f;
+
+    // The cached tile stays while it still covers the slice and the casters in front of it
+    auto& fit = cascadeFits[i];
+    const bool covered = enableCaching && fit.fitted
+      && fit.lightRotation == shadow_cam.rotation
+      && fit.radius == coverRadius
+      && std::abs(lightCenter.x - fit.center.x) + radius <= fit.radius
+      && std::abs(lightCenter.y - fit.center.y) + radius <= fit.radius
+      && fit.minZ <= sliceMinZ
+      && fit.maxZ >= sliceMaxZ;
+
+    if (!covered)
+    {
+      // Snapping the center to whole texels keeps shadow edges still while the camera moves
+      const float texelSize = 2.0f * coverRadius / float(SHADOW_CASCADE_RESOLUTION);
+      fit = CascadeFit{
+        .lightRotation = shadow_cam.rotation,
+        .center = glm::floor(glm::vec2(lightCenter) / texelSize) * texelSize,
+        .radius = coverRadius,
+        .minZ = std::min(sceneMinZ, lightCenter.z - coverRadius),
+        .maxZ = lightCenter.z + coverRadius,
+        .fitted = true,
+        .dirty = true,
+      };
+
+      cascadeMatrices[i] = glm::orthoLH_ZO(
+        fit.center.x + fit.radius,
+        fit.center.x - fit.radius,
+        fit.center.y + fit.radius,
+        fit.center.y - fit.radius,
+        fit.minZ,
+        fit.maxZ) * lightRotation;
+    }
+
+    sliceNear = sliceFar;
+  }
+}
+
+void CascadedShadowMap::invalidate(const SceneBounds& region)
+{
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    if (!cascadeFits[i].fitted)
+      continue;
+
+    glm::vec3 ndcMin{std::numeric_limits<float>::max()};
+    glm::vec3 ndcMax{-std::numeric_limits<float>::max()};
+    for (std::uint32_t corner = 0; corner < 8; ++corner)
+    {
+      const glm::vec3 p{
+        (corner & 1) ? region.max.x : region.min.x,
+        (corner & 2) ? region.max.y : region.min.y,
+        (corner & 4) ? region.max.z : region.min.z};
+      // Cascades are orthographic, w stays 1
+      const glm::vec3 ndc = glm::vec3(cascadeMatrices[i] * glm::vec4(p, 1.0f));
+      ndcMin = glm::min(ndcMin, ndc);
+      ndcMax = glm::max(ndcMax, ndc);
+    }
+
+    if (glm::all(glm::lessThanEqual(ndcMin, glm::vec3(1.0f)))
+      && glm::all(glm::greaterThanEqual(ndcMax, glm::vec3(-1.0f, -1.0f, 0.0f))))
+      cascadeFits[i].dirty = true;
+  }
+}
+
+void CascadedShadowMap::invalidateAll()
+{
+  for (auto& fit : cascadeFits)
+    fit.dirty = true;
+}
+
+void CascadedShadowMap::render(vk::CommandBuffer cmd_buf, const SceneCuller& culler)
+{
+  redrawnCascades = 0;
+  for (const auto& fit : cascadeFits)
+    redrawnCascades += fit.dirty ? 1 : 0;
+  if (redrawnCascades == 0)
+    return;
+
+  ETNA_PROFILE_GPU(cmd_buf, renderShadowCascades);
+
+  auto shadowInfo = etna::get_shader_program("simple_shadow");
+  auto set = etna::create_descriptor_set(
+    shadowInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{2, culler.getInstanceMatrices().genBinding()},
+      etna::Binding{3, culler.getVisibleInstances().genBinding()},
+    });
+
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+  {
+    if (!cascadeFits[i].dirty)
+      continue;
+    cascadeFits[i].dirty = false;
+
+    const vk::Offset2D tileOffset{
+      static_cast<std::int32_t>(i % SHADOW_ATLAS_TILES * SHADOW_CASCADE_RESOLUTION),
+      static_cast<std::int32_t>(i / SHADOW_ATLAS_TILES * SHADOW_CASCADE_RESOLUTION)};
+
+    // The render area of a cascade is its tile, the clear leaves other tiles alone
+    etna::RenderTargetState renderTargets(
+      cmd_buf,
+      {tileOffset, {SHADOW_CASCADE_RESOLUTION, SHADOW_CASCADE_RESOLUTION}},
+      {},
+      {.image = atlas.get(), .view = atlas.getView({})});
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eGraphics,
+      shadowPipeline.getVkPipelineLayout(),
+      0,
+      {set.getVkSet()},
+      {});
+    cmd_buf.pushConstants<glm::mat4>(
+      shadowPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eVertex, 0, {cascadeMatrices[i]});
+
+    culler.draw(cmd_buf, 1 + i);
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <etna/Image.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <glm/glm.hpp>
+#include <array>
+#include <vulkan/vulkan.hpp>
+
+#include "shaders/UniformParams.h"
+#include "scene/Camera.hpp"
+#include "SceneCuller.hpp"
+
+
+/**
+ * Cascaded shadow maps of a directional light. Cascades split the view
+ * between the camera near plane and the shadow distance, each one is a tile
+ * of a single depth atlas and only draws the casters its culling view kept.
+ * Tiles are cached: a cascade covers its slice with a guard band and is only
+ * refitted and redrawn once the slice leaves it, the light turns or casters
+ * inside it change.
+ */
+class CascadedShadowMap
+{
+public:
+  void allocateResources();
+  void loadShaders();
+  void setupPipelines(const etna::VertexShaderInputDescription& vertex_input);
+
+  // Fits every cascade around its slice of the main view, the light shines along shadow_cam's forward
+  void update(const Camera& main_cam, float aspect, const Camera& shadow_cam, const SceneBounds& scene_bounds);
+  // Cascades overlapping a world-space region get redrawn, e.g. after instances move
+  void invalidate(const SceneBounds& region);
+  void invalidateAll();
+  // Redraws invalidated cascades only, the culler views 1 + i must have been
+  // culled against getCascadeMatrix(i)
+  void render(vk::CommandBuffer cmd_buf, const SceneCuller& culler);
+
+  const etna::Image& getAtlas() const { return atlas; }
+  const glm::mat4&   getCascadeMatrix(std::uint32_t cascade) const { return cascadeMatrices[cascade]; }
+  // View distance where a cascade ends
+  float getSplitDistance(std::uint32_t cascade) const { return splitDistances[cascade]; }
+
+  // 0 splits uniformly, 1 logarithmically
+  float getSplitLambda() const { return splitLambda; }
+  void  setSplitLambda(float lambda) { splitLambda = glm::clamp(lambda, 0.0f, 1.0f); }
+  float getShadowDistance() const { return shadowDistance; }
+  void  setShadowDistance(float distance) { shadowDistance = glm::max(distance, 1.0f); }
+
+  bool  getCaching() const { return enableCaching; }
+  void  setCaching(bool enable) { enableCaching = enable; invalidateAll(); }
+  // Extra cascade radius, larger bands refit less often at the cost of resolution
+  float getGuardBand() const { return guardBand; }
+  void  setGuardBand(float band) { guardBand = glm::clamp(band, 0.0f, 1.0f); }
+  // Cascades drawn by the last render
+  std::uint32_t getRedrawnCascades() const { return redrawnCascades; }
+
+private:
+  static constexpr std::uint32_t ATLAS_SIZE = SHADOW_CASCADE_RESOLUTION * SHADOW_ATLAS_TILES;
+
+  etna::Image atlas;
+  etna::GraphicsPipeline shadowPipeline{};
+
+  // Light-space box a cascade was fitted to, its tile stays valid while nothing inside changes
+  struct CascadeFit
+  {
+    glm::quat lightRotation{};
+    glm::vec2 center{0.0f};
+    float radius = 0.0f;
+    float minZ = 0.0f;
+    float maxZ = 0.0f;
+    bool fitted = false;
+    bool dirty = true;
+  };
+
+  std::array<CascadeFit, SHADOW_CASCADE_COUNT> cascadeFits{};
+  std::array<glm::mat4, SHADOW_CASCADE_COUNT> cascadeMatrices{};
+  std::array<float, SHADOW_CASCADE_COUNT> splitDistances{};
+
+  float splitLambda = 0.75f;
+  float shadowDistance = 60.0f;
+  bool  enableCaching = true;
+  float guardBand = 0.2f;
+  std::uint32_t redrawnCascades = 0;
+};
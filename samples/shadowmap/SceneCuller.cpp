@@ -0,0 +1,332 @@
+#include "SceneCuller.hpp"
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/Profiling.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "render_utils/Barriers.hpp"
+#include "render_utils/Frustum.hpp"
+
+namespace
+{
+
+SceneBounds transform_bounds(const SceneBounds& local, const glm::mat4& transform)
+{
+  SceneBounds world{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+  for (std::uint32_t corner = 0; corner < 8; ++corner)
+  {
+    const glm::vec3 p{
+      (corner & 1) ? local.max.x : local.min.x,
+      (corner & 2) ? local.max.y : local.min.y,
+      (corner & 4) ? local.max.z : local.min.z};
+    const glm::vec3 transformed = glm::vec3(transform * glm::vec4(p, 1.0f));
+    world.min = glm::min(world.min, transformed);
+    world.max = glm::max(world.max, transformed);
+  }
+  return world;
+}
+
+SceneBounds merge_bounds(const SceneBounds& a, const SceneBounds& b)
+{
+  return SceneBounds{glm::min(a.min, b.min), glm::max(a.max, b.max)};
+}
+
+// VkDrawIndexedIndirectCommand, as written by scene_cull_args.comp
+constexpr std::uint32_t DRAW_ARGS_STRIDE = 5 * sizeof(std::uint32_t);
+
+constexpr std::uint32_t group_count(std::uint32_t count)
+{
+  return (count + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+}
+
+} // namespace
+
+void SceneCuller::loadShaders()
+{
+  etna::create_program("scene_cull", {SHADOWMAP_SHADERS_ROOT "scene_cull.comp.spv"});
+  etna::create_program("scene_cull_args", {SHADOWMAP_SHADERS_ROOT "scene_cull_args.comp.spv"});
+}
+
+void SceneCuller::setupPipelines()
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  cullPipeline = pipelineManager.createComputePipeline("scene_cull", {});
+  argsPipeline = pipelineManager.createComputePipeline("scene_cull_args", {});
+}
+
+void SceneCuller::loadScene(SceneManager& scene)
+{
+  vertexBuffer = scene.getVertexBuffer();
+  indexBuffer  = scene.getIndexBuffer();
+
+  const auto sceneMatrices    = scene.getInstanceMatrices();
+  const auto instanceMeshes   = scene.getInstanceMeshes();
+  const auto meshes           = scene.getMeshes();
+  const auto relems           = scene.getRenderElements();
+  const auto relemBoxes       = scene.getRelemsBoundingBoxes();
+
+  instanceCount = static_cast<std::uint32_t>(sceneMatrices.size());
+  meshCount     = static_cast<std::uint32_t>(meshes.size());
+  relemCount    = static_cast<std::uint32_t>(relems.size());
+
+  // Local bounds of a mesh enclose all of its relems
+  meshBounds.assign(meshCount, SceneBounds{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)});
+  for (std::uint32_t meshIdx = 0; meshIdx < meshCount; ++meshIdx)
+    for (std::uint32_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+    {
+      const auto& aabb = relemBoxes[meshes[meshIdx].firstRelem + j].aabb;
+      meshBounds[meshIdx].min = glm::min(meshBounds[meshIdx].min, glm::vec3(aabb.minX, aabb.minY, aabb.minZ));
+      meshBounds[meshIdx].max = glm::max(meshBounds[meshIdx].max, glm::vec3(aabb.maxX, aabb.maxY, aabb.maxZ));
+    }
+
+  // Instances of a mesh get consecutive slots in the visible list of every view
+  std::vector<std::uint32_t> meshFirstSlots(meshCount, 0);
+  for (auto meshIdx : instanceMeshes)
+    ++meshFirstSlots[meshIdx];
+  std::uint32_t slot = 0;
+  for (auto& firstSlot : meshFirstSlots)
+    slot += std::exchange(firstSlot, slot);
+
+  instanceMatrices.assign(sceneMatrices.begin(), sceneMatrices.end());
+  movedInstances.clear();
+  changedRegion.reset();
+
+  sceneBounds = SceneBounds{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+  cullInstances.resize(instanceCount);
+  for (std::uint32_t instIdx = 0; instIdx < instanceCount; ++instIdx)
+  {
+    const auto meshIdx = instanceMeshes[instIdx];
+    const SceneBounds world = transform_bounds(meshBounds[meshIdx], instanceMatrices[instIdx]);
+    sceneBounds = merge_bounds(sceneBounds, world);
+
+    cullInstances[instIdx] = CullInstance{
+      .boundsMin = world.min,
+      .mesh = meshIdx,
+      .boundsMax = world.max,
+      .firstSlot = meshFirstSlots[meshIdx],
+    };
+  }
+  if (instanceCount == 0)
+    sceneBounds = SceneBounds{};
+
+  std::vector<CullRelem> cullRelems(relemCount, CullRelem{});
+  for (std::uint32_t meshIdx = 0; meshIdx < meshCount; ++meshIdx)
+    for (std::uint32_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+    {
+      const auto relemIdx = meshes[meshIdx].firstRelem + j;
+      const auto& relem = relems[relemIdx];
+      cullRelems[relemIdx] = CullRelem{
+        .indexCount = relem.indexCount,
+        .firstIndex = relem.indexOffset,
+        .vertexOffset = static_cast<std::uint32_t>(relem.vertexOffset),
+        .mesh = meshIdx,
+        .firstSlot = meshFirstSlots[meshIdx],
+      };
+    }
+
+  auto& ctx = etna::get_context();
+
+  // Scene data stays in host memory, it is written once and patched by the culls after instance moves
+  auto createStatic = [&ctx](const void* data, std::size_t size, const char* name) {
+    auto buffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = std::max<std::size_t>(size, 4),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+      .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .name = name,
+    });
+    if (size > 0)
+      std::memcpy(buffer.map(), data, size);
+    return buffer;
+  };
+  instanceMatricesBuffer = createStatic(
+    instanceMatrices.data(), instanceMatrices.size() * sizeof(glm::mat4), "cull_instance_matrices");
+  cullInstancesBuffer = createStatic(
+    cullInstances.data(), cullInstances.size() * sizeof(CullInstance), "cull_instances");
+  cullRelemsBuffer = createStatic(
+    cullRelems.data(), cullRelems.size() * sizeof(CullRelem), "cull_relems");
+
+  countersBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = std::max<std::size_t>(sizeof(std::uint32_t) * CULL_VIEW_COUNT * meshCount, 4),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "cull_counters",
+  });
+
+  visibleInstancesBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = std::max<std::size_t>(sizeof(std::uint32_t) * CULL_VIEW_COUNT * instanceCount, 4),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "cull_visible_instances",
+  });
+
+  drawArgsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = std::max<std::size_t>(std::size_t{DRAW_ARGS_STRIDE} * CULL_VIEW_COUNT * relemCount, 4),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "cull_draw_args",
+  });
+
+  viewsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(CullView) * CULL_VIEW_COUNT * FRAME_RING,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "cull_views",
+  });
+  viewsMapping = viewsBuffer.map();
+}
+
+void SceneCuller::setInstanceTransform(std::uint32_t instance, const glm::mat4& transform)
+{
+  if (instance >= instanceCount)
+    return;
+
+  auto& cullInstance = cullInstances[instance];
+  const SceneBounds oldBounds{cullInstance.boundsMin, cullInstance.boundsMax};
+  const SceneBounds newBounds = transform_bounds(meshBounds[cullInstance.mesh], transform);
+
+  instanceMatrices[instance] = transform;
+  cullInstance.boundsMin = newBounds.min;
+  cullInstance.boundsMax = newBounds.max;
+  sceneBounds = merge_bounds(sceneBounds, newBounds);
+
+  const SceneBounds moved = merge_bounds(oldBounds, newBounds);
+  changedRegion = changedRegion ? merge_bounds(*changedRegion, moved) : moved;
+
+  if (std::find(movedInstances.begin(), movedInstances.end(), instance) == movedInstances.end())
+    movedInstances.push_back(instance);
+}
+
+std::optional<SceneBounds> SceneCuller::takeChangedRegion()
+{
+  return std::exchange(changedRegion, std::nullopt);
+}
+
+void SceneCuller::setViews(const std::array<glm::mat4, CULL_VIEW_COUNT>& view_projs)
+{
+  if (viewsMapping == nullptr)
+    return;
+
+  viewsSection = (viewsSection + 1) % FRAME_RING;
+
+  std::array<CullView, CULL_VIEW_COUNT> views;
+  for (std::uint32_t i = 0; i < CULL_VIEW_COUNT; ++i)
+    extract_frustum_planes(view_projs[i], views[i].planes);
+
+  std::memcpy(
+    static_cast<CullView*>(viewsMapping) + viewsSection * CULL_VIEW_COUNT, views.data(), sizeof(views));
+}
+
+void SceneCuller::cull(vk::CommandBuffer cmd_buf)
+{
+  if (instanceCount == 0)
+    return;
+
+  ETNA_PROFILE_GPU(cmd_buf, cullScene);
+
+  const CullPushConstants pushConstants{
+    .firstView = viewsSection * CULL_VIEW_COUNT,
+    .instanceCount = instanceCount,
+    .meshCount = meshCount,
+    .relemCount = relemCount,
+  };
+
+  // Draws of the previous frame are done with the lists before they get rewritten
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexShader,
+    {},
+    vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eShaderStorageWrite);
+
+  cmd_buf.fillBuffer(countersBuffer.get(), 0, VK_WHOLE_SIZE, 0);
+
+  // Moved instances are patched in order with the frames still reading the old data
+  for (auto instIdx : movedInstances)
+  {
+    cmd_buf.updateBuffer(
+      instanceMatricesBuffer.get(), sizeof(glm::mat4) * instIdx, sizeof(glm::mat4), &instanceMatrices[instIdx]);
+    cmd_buf.updateBuffer(
+      cullInstancesBuffer.get(), sizeof(CullInstance) * instIdx, sizeof(CullInstance), &cullInstances[instIdx]);
+  }
+  movedInstances.clear();
+
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eVertexShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+  {
+    auto cullInfo = etna::get_shader_program("scene_cull");
+    auto set = etna::create_descriptor_set(
+      cullInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, cullInstancesBuffer.genBinding()},
+        etna::Binding{1, viewsBuffer.genBinding()},
+        etna::Binding{2, countersBuffer.genBinding()},
+        etna::Binding{3, visibleInstancesBuffer.genBinding()},
+      });
+    vk::DescriptorSet vkSet = set.getVkSet();
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, cullPipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+    cmd_buf.pushConstants(
+      cullPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+    cmd_buf.dispatch(group_count(instanceCount), CULL_VIEW_COUNT, 1);
+  }
+
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead);
+
+  {
+    auto argsInfo = etna::get_shader_program("scene_cull_args");
+    auto set = etna::create_descriptor_set(
+      argsInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, cullRelemsBuffer.genBinding()},
+        etna::Binding{1, countersBuffer.genBinding()},
+        etna::Binding{2, drawArgsBuffer.genBinding()},
+      });
+    vk::DescriptorSet vkSet = set.getVkSet();
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, argsPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, argsPipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+    cmd_buf.pushConstants(
+      argsPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+    cmd_buf.dispatch(group_count(relemCount), CULL_VIEW_COUNT, 1);
+  }
+
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexShader,
+    vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eShaderStorageRead);
+}
+
+void SceneCuller::draw(vk::CommandBuffer cmd_buf, std::uint32_t view) const
+{
+  if (instanceCount == 0 || relemCount == 0)
+    return;
+
+  cmd_buf.bindVertexBuffers(0, {vertexBuffer}, {0});
+  cmd_buf.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint32);
+  cmd_buf.drawIndexedIndirect(
+    drawArgsBuffer.get(), vk::DeviceSize{DRAW_ARGS_STRIDE} * view * relemCount, relemCount, DRAW_ARGS_STRIDE);
+}
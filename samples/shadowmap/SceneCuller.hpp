@@ -0,0 +1,83 @@
+#pragma once
+
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "shaders/UniformParams.h"
+#include "scene/SceneManager.hpp"
+
+
+struct SceneBounds
+{
+  glm::vec3 min{0.0f};
+  glm::vec3 max{0.0f};
+};
+
+/**
+ * Culls scene instances on the GPU against several views at once and draws
+ * the survivors of a view with one instanced multi-draw, a command per relem.
+ * The vertex shader fetches its matrix through the visible instance list.
+ */
+class SceneCuller
+{
+public:
+  void loadShaders();
+  void setupPipelines();
+  // Uploads instance bounds and matrices
+  void loadScene(SceneManager& scene);
+  // Moves an instance, the upload is recorded by the next cull
+  void setInstanceTransform(std::uint32_t instance, const glm::mat4& transform);
+  // World-space region touched by instances moved since the last call, old and new bounds included
+  std::optional<SceneBounds> takeChangedRegion();
+
+  // Frustum of every view for the next cull, the view-projections are taken
+  // as is, near and far planes included
+  void setViews(const std::array<glm::mat4, CULL_VIEW_COUNT>& view_projs);
+  // Must be recorded outside of rendering, before any draw of this frame
+  void cull(vk::CommandBuffer cmd_buf);
+  void draw(vk::CommandBuffer cmd_buf, std::uint32_t view) const;
+
+  const etna::Buffer& getInstanceMatrices() const { return instanceMatricesBuffer; }
+  const etna::Buffer& getVisibleInstances() const { return visibleInstancesBuffer; }
+  const SceneBounds&  getSceneBounds     () const { return sceneBounds;            }
+  std::uint32_t       getInstanceCount   () const { return instanceCount;          }
+  const glm::mat4&    getInstanceTransform(std::uint32_t instance) const { return instanceMatrices[instance]; }
+
+private:
+  vk::Buffer vertexBuffer;
+  vk::Buffer indexBuffer;
+
+  std::uint32_t instanceCount = 0;
+  std::uint32_t meshCount     = 0;
+  std::uint32_t relemCount    = 0;
+  SceneBounds sceneBounds;
+
+  // CPU copies for instance moves
+  std::vector<SceneBounds>  meshBounds;
+  std::vector<CullInstance> cullInstances;
+  std::vector<glm::mat4>    instanceMatrices;
+  std::vector<std::uint32_t> movedInstances;
+  std::optional<SceneBounds> changedRegion;
+
+  etna::Buffer instanceMatricesBuffer;
+  etna::Buffer cullInstancesBuffer;
+  etna::Buffer cullRelemsBuffer;
+  etna::Buffer countersBuffer;
+  etna::Buffer visibleInstancesBuffer;
+  etna::Buffer drawArgsBuffer;
+
+  // Views of the last few frames, a section per frame in flight
+  static constexpr std::uint32_t FRAME_RING = 3;
+  etna::Buffer viewsBuffer;
+  void* viewsMapping = nullptr;
+  std::uint32_t viewsSection = 0;
+
+  etna::ComputePipeline cullPipeline{};
+  etna::ComputePipeline argsPipeline{};
+};
@@ -6,10 +6,14 @@
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
 #include <imgui.h>
+#include <cmath>
+#include <utility>
 
 
 WorldRenderer::WorldRenderer()
   : sceneMgr{std::make_unique<SceneManager>()}
+  , sceneCuller{std::make_unique<SceneCuller>()}
+  , shadowCascades{std::make_unique<CascadedShadowMap>()}
 {
 }
 
@@ -26,13 +30,7 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
     .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
   });
 
-  shadowMap = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{2048, 2048, 1},
-    .name = "shadow_map",
-    .format = vk::Format::eD16Unorm,
-    .imageUsage =
-      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
-  });
+  shadowCascades->allocateResources();
 
   defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
   constants = ctx.createBuffer(etna::Buffer::CreateInfo{
@@ -48,6 +46,9 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
   sceneMgr->selectScene(path);
+  sceneCuller->loadScene(*sceneMgr);
+  shadowCascades->invalidateAll();
+  movingInstanceRest.reset();
 }
 
 void WorldRenderer::loadShaders()
@@ -55,7 +56,8 @@ void WorldRenderer::loadShaders()
   etna::create_program(
     "simple_material",
     {SHADOWMAP_SHADERS_ROOT "simple_shadow.frag.spv", SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
-  etna::create_program("simple_shadow", {SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
+  shadowCascades->loadShaders();
+  sceneCuller->loadShaders();
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
@@ -93,32 +95,14 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
         },
     });
 
-  shadowPipeline = {};
-  shadowPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_shadow",
-    etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .depthAttachmentFormat = vk::Format::eD16Unorm,
-        },
-    });
+  shadowCascades->setupPipelines(sceneVertexInputDesc);
+  sceneCuller->setupPipelines();
 }
 
 void WorldRenderer::debugInput(const Keyboard& kb)
 {
   if (kb[KeyboardKey::kQ] == ButtonState::Falling)
     drawDebugFSQuad = !drawDebugFSQuad;
-
-  if (kb[KeyboardKey::kP] == ButtonState::Falling)
-    lightProps.usePerspectiveM = !lightProps.usePerspectiveM;
 }
 
 void WorldRenderer::update(const FramePacket& packet)
@@ -126,72 +110,54 @@ void WorldRenderer::update(const FramePacket& packet)
   ZoneScoped;
 
   // calc camera matrix
-  {
-    const float aspect = float(resolution.x) / float(resolution.y);
-    worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
-  }
+  const float aspect = float(resolution.x) / float(resolution.y);
+  worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+
+  updateMovingInstance(packet.currentTime);
 
-  // calc light matrix
+  // fit shadow cascades around the view, cached ones are only redrawn when something in them changed
+  shadowCascades->update(packet.mainCam, aspect, packet.shadowCam, sceneCuller->getSceneBounds());
+  if (auto changedRegion = sceneCuller->takeChangedRegion())
+    shadowCascades->invalidate(*changedRegion);
+
+  // the camera and every cascade cull the scene in a single pass
   {
-    const auto mProj = lightProps.usePerspectiveM
-      ? glm::perspectiveLH_ZO(
-          -glm::radians(packet.shadowCam.fov), 1.0f, 1.0f, lightProps.lightTargetDist * 2.0f)
-      : glm::orthoLH_ZO(
-          +lightProps.radius,
-          -lightProps.radius,
-          +lightProps.radius,
-          -lightProps.radius,
-          0.0f,
-          lightProps.lightTargetDist);
-
-    lightMatrix = mProj * packet.shadowCam.viewTm();
-
-    lightPos = packet.shadowCam.position;
+    std::array<glm::mat4, CULL_VIEW_COUNT> cullViews;
+    cullViews[0] = worldViewProj;
+    for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+      cullViews[1 + i] = shadowCascades->getCascadeMatrix(i);
+    sceneCuller->setViews(cullViews);
   }
 
   // Upload everything to GPU-mapped memory
   {
-    uniformParams.lightMatrix = lightMatrix;
-    uniformParams.lightPos = lightPos;
+    for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+      uniformParams.cascadeMatrices[i] = shadowCascades->getCascadeMatrix(i);
+    uniformParams.lightPos = packet.shadowCam.position;
     uniformParams.time = packet.currentTime;
 
     std::memcpy(constants.data(), &uniformParams, sizeof(uniformParams));
   }
 }
 
-void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+void WorldRenderer::updateMovingInstance(float time)
 {
-  if (!sceneMgr->getVertexBuffer())
+  if (movingInstance >= sceneCuller->getInstanceCount())
     return;
 
-  cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
-
-  pushConst2M.projView = glob_tm;
-
-  auto instanceMeshes = sceneMgr->getInstanceMeshes();
-  auto instanceMatrices = sceneMgr->getInstanceMatrices();
-
-  auto meshes = sceneMgr->getMeshes();
-  auto relems = sceneMgr->getRenderElements();
-
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  if (!moveInstance)
   {
-    pushConst2M.model = instanceMatrices[instIdx];
-
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+    // Put it back where the scene had it
+    if (movingInstanceRest)
+      sceneCuller->setInstanceTransform(movingInstance, *std::exchange(movingInstanceRest, std::nullopt));
+    return;
+  }
 
-    const auto meshIdx = instanceMeshes[instIdx];
+  if (!movingInstanceRest)
+    movingInstanceRest = sceneCuller->getInstanceTransform(movingInstance);
 
-    for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
-    {
-      const auto relemIdx = meshes[meshIdx].firstRelem + j;
-      const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
-    }
-  }
+  const glm::vec3 offset{2.0f * std::sin(time), 0.0f, 2.0f * std::cos(time)};
+  sceneCuller->setInstanceTransform(movingInstance, glm::translate(glm::mat4(1.0f), offset) * *movingInstanceRest);
 }
 
 void WorldRenderer::renderWorld(
@@ -199,20 +165,11 @@ void WorldRenderer::renderWorld(
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
-  // draw scene to shadowmap
-
-  {
-    ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
+  sceneCuller->cull(cmd_buf);
 
-    etna::RenderTargetState renderTargets(
-      cmd_buf,
-      {{0, 0}, {2048, 2048}},
-      {},
-      {.image = shadowMap.get(), .view = shadowMap.getView({})});
+  // draw scene to shadowmap
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
-    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout());
-  }
+  shadowCascades->render(cmd_buf, *sceneCuller);
 
   // draw final scene to screen
 
@@ -226,7 +183,11 @@ void WorldRenderer::renderWorld(
       cmd_buf,
       {etna::Binding{0, constants.genBinding()},
        etna::Binding{
-         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+         1,
+         shadowCascades->getAtlas().genBinding(
+           defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+       etna::Binding{2, sceneCuller->getInstanceMatrices().genBinding()},
+       etna::Binding{3, sceneCuller->getVisibleInstances().genBinding()}});
 
     etna::RenderTargetState renderTargets(
       cmd_buf,
@@ -242,11 +203,15 @@ void WorldRenderer::renderWorld(
       {set.getVkSet()},
       {});
 
-    renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout());
+    cmd_buf.pushConstants<glm::mat4>(
+      basicForwardPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eVertex, 0, {worldViewProj});
+
+    sceneCuller->draw(cmd_buf, 0);
   }
 
   if (drawDebugFSQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, shadowMap, defaultSampler);
+    quadRenderer->render(
+      cmd_buf, target_image, target_image_view, shadowCascades->getAtlas(), defaultSampler);
 }
 
 void WorldRenderer::drawGui()
@@ -262,6 +227,37 @@ void WorldRenderer::drawGui()
   ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
   uniformParams.lightPos = {pos[0], pos[1], pos[2]};
 
+  ImGui::NewLine();
+
+  float splitLambda = shadowCascades->getSplitLambda();
+  if (ImGui::SliderFloat("Cascade split lambda", &splitLambda, 0.0f, 1.0f))
+    shadowCascades->setSplitLambda(splitLambda);
+  float shadowDistance = shadowCascades->getShadowDistance();
+  if (ImGui::SliderFloat("Shadow distance", &shadowDistance, 5.0f, 500.0f))
+    shadowCascades->setShadowDistance(shadowDistance);
+  bool showCascades = uniformParams.showCascades != 0;
+  ImGui::Checkbox("Show cascades", &showCascades);
+  uniformParams.showCascades = showCascades;
+  for (std::uint32_t i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+    ImGui::Text("Cascade %u ends at %.2f", i, shadowCascades->getSplitDistance(i));
+
+  bool cacheShadows = shadowCascades->getCaching();
+  if (ImGui::Checkbox("Cache shadow cascades", &cacheShadows))
+    shadowCascades->setCaching(cacheShadows);
+  float guardBand = shadowCascades->getGuardBand();
+  if (ImGui::SliderFloat("Cascade guard band", &guardBand, 0.0f, 0.5f))
+    shadowCascades->setGuardBand(guardBand);
+  ImGui::Text("Cascades redrawn last frame: %u", shadowCascades->getRedrawnCascades());
+
+  ImGui::Checkbox("Move an instance", &moveInstance);
+  // The instance only changes while it rests, so that it is put back in place
+  if (!moveInstance && sceneCuller->getInstanceCount() > 0)
+  {
+    int instance = static_cast<int>(movingInstance);
+    if (ImGui::SliderInt("Moving instance", &instance, 0, static_cast<int>(sceneCuller->getInstanceCount()) - 1))
+      movingInstance = static_cast<std::uint32_t>(instance);
+  }
+
   ImGui::Text(
     "Application average %.3f ms/frame (%.1f FPS)",
     1000.0f / ImGui::GetIO().Framerate,
@@ -5,6 +5,7 @@
 #include <etna/Buffer.hpp>
 #include <etna/GraphicsPipeline.hpp>
 #include <glm/glm.hpp>
+#include <optional>
 
 #include "shaders/UniformParams.h"
 #include "scene/SceneManager.hpp"
@@ -12,6 +13,8 @@
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
+#include "SceneCuller.hpp"
+#include "CascadedShadowMap.hpp"
 
 
 /**
@@ -35,48 +38,35 @@ public:
   void renderWorld(
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
-private:
-  void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
-
-
 private:
   std::unique_ptr<SceneManager> sceneMgr;
+  std::unique_ptr<SceneCuller> sceneCuller;
+  std::unique_ptr<CascadedShadowMap> shadowCascades;
 
   etna::Image mainViewDepth;
-  etna::Image shadowMap;
   etna::Sampler defaultSampler;
   etna::Buffer constants;
 
-  struct PushConstants
-  {
-    glm::mat4x4 projView;
-    glm::mat4x4 model;
-  } pushConst2M;
-
   glm::mat4x4 worldViewProj;
-  glm::mat4x4 lightMatrix;
-  glm::vec3 lightPos;
-
-  struct ShadowMapCam
-  {
-    float radius = 10;
-    float lightTargetDist = 24;
-    bool usePerspectiveM = false;
-  } lightProps;
 
   UniformParams uniformParams{
-    .lightMatrix = {},
+    .cascadeMatrices = {},
     .lightPos = {},
     .time = {},
     .baseColor = {0.9f, 0.92f, 1.0f},
+    .showCascades = false,
   };
 
   etna::GraphicsPipeline basicForwardPipeline{};
-  etna::GraphicsPipeline shadowPipeline{};
 
   std::unique_ptr<QuadRenderer> quadRenderer;
   bool drawDebugFSQuad = false;
 
+  // Moves one instance in a circle, the cascades it passes through get redrawn
+  void updateMovingInstance(float time);
+  bool moveInstance = false;
+  std::uint32_t movingInstance = 0;
+  std::optional<glm::mat4> movingInstanceRest;
+
   glm::uvec2 resolution;
 };
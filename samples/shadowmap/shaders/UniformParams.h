@@ -4,12 +4,57 @@
 #include "cpp_glsl_compat.h"
 
 
+// Cascades are tiles of one depth atlas, SHADOW_ATLAS_TILES per side
+#define SHADOW_CASCADE_COUNT      4
+#define SHADOW_CASCADE_RESOLUTION 2048
+#define SHADOW_ATLAS_TILES        2
+
+// Instances are culled on the GPU against the main view and every cascade,
+// view 0 is the camera, view 1 + i is cascade i
+#define CULL_VIEW_COUNT     (SHADOW_CASCADE_COUNT + 1)
+#define CULL_WORKGROUP_SIZE 64
+
 struct UniformParams
 {
-  shader_mat4 lightMatrix;
+  // Light view-projection of every cascade, each maps to its own atlas tile
+  shader_mat4 cascadeMatrices[SHADOW_CASCADE_COUNT];
   shader_vec3 lightPos;
   shader_float time;
   shader_vec3 baseColor;
+  shader_bool showCascades;
+};
+
+// World space bounds of an instance, firstSlot is where the visible
+// instances of its mesh start inside the section of a view
+struct CullInstance
+{
+  shader_vec3 boundsMin;
+  shader_uint mesh;
+  shader_vec3 boundsMax;
+  shader_uint firstSlot;
+};
+
+// Static part of the indirect draw of a relem, vertexOffset holds the bits of an int
+struct CullRelem
+{
+  shader_uint indexCount;
+  shader_uint firstIndex;
+  shader_uint vertexOffset;
+  shader_uint mesh;
+  shader_uint firstSlot;
+};
+
+struct CullView
+{
+  shader_vec4 planes[6];
+};
+
+struct CullPushConstants
+{
+  shader_uint firstView; // section of the view ring written this frame
+  shader_uint instanceCount;
+  shader_uint meshCount;
+  shader_uint relemCount;
 };
 
 
@@ -11,9 +11,19 @@ layout(location = 1) in vec4 vTexCoordAndTang;
 layout(push_constant) uniform params_t
 {
   mat4 mProjView;
-  mat4 mModel;
 } params;
 
+layout(binding = 2, std430) restrict readonly buffer InstanceMatrices
+{
+  mat4 instanceMatrices[];
+};
+
+// Written by the culling pass, draws of a view start at the view's section
+layout(binding = 3, std430) restrict readonly buffer VisibleInstances
+{
+  uint visibleInstances[];
+};
+
 
 layout (location = 0 ) out VS_OUT
 {
@@ -26,12 +36,14 @@ layout (location = 0 ) out VS_OUT
 out gl_PerVertex { vec4 gl_Position; };
 void main(void)
 {
+  const mat4 mModel = instanceMatrices[visibleInstances[gl_InstanceIndex]];
+
   const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
   const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
 
-  vOut.wPos = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-  vOut.wNorm = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
-  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
+  vOut.wPos = (mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
+  vOut.wNorm = normalize(mat3(transpose(inverse(mModel))) * wNorm.xyz);
+  vOut.wTangent = normalize(mat3(transpose(inverse(mModel))) * wTang.xyz);
   vOut.texCoord = vTexCoordAndTang.xy;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
@@ -20,20 +20,48 @@ layout(binding = 0, set = 0) uniform AppData
   UniformParams params;
 };
 
+// All cascades, SHADOW_ATLAS_TILES x SHADOW_ATLAS_TILES tiles
 layout(binding = 1) uniform sampler2D shadowMap;
 
-void main()
+// Keeps the PCF footprint inside the tile of the chosen cascade
+const float CASCADE_MARGIN = 1.5f / SHADOW_CASCADE_RESOLUTION;
+const float ATLAS_TEXEL = 1.0f / (SHADOW_CASCADE_RESOLUTION * SHADOW_ATLAS_TILES);
+
+// Lit fraction of a point, 1 outside of every cascade
+float shadowFactor(out int cascade)
 {
-  const vec4 posLightClipSpace = params.lightMatrix*vec4(surf.wPos, 1.0f);
+  for (cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade)
+  {
+    // Cascades are orthographic, no perspective division needed
+    const vec3 posLightSpaceNDC = (params.cascadeMatrices[cascade] * vec4(surf.wPos, 1.0f)).xyz;
+    // just shift coords from [-1,1] to [0,1]
+    const vec2 tileTexCoord = posLightSpaceNDC.xy * 0.5f + vec2(0.5f, 0.5f);
 
-  // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
-  const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
+    // Cascades are ordered by size, the first one containing the point has the sharpest shadow
+    if (any(lessThan(tileTexCoord, vec2(CASCADE_MARGIN))) || any(greaterThan(tileTexCoord, vec2(1.0f - CASCADE_MARGIN)))
+      || posLightSpaceNDC.z > 1.0f)
+      continue;
 
-  // just shift coords from [-1,1] to [0,1]
-  const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
+    const vec2 tile = vec2(cascade % SHADOW_ATLAS_TILES, cascade / SHADOW_ATLAS_TILES);
+    const vec2 shadowTexCoord = (tileTexCoord + tile) / SHADOW_ATLAS_TILES;
 
-  const bool  outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f);
-  const float shadow    = ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+    // 3x3 PCF
+    float lit = 0.0f;
+    for (int y = -1; y <= 1; ++y)
+      for (int x = -1; x <= 1; ++x)
+      {
+        const float depth = textureLod(shadowMap, shadowTexCoord + vec2(x, y) * ATLAS_TEXEL, 0).x;
+        lit += posLightSpaceNDC.z < depth + 0.001f ? 1.0f : 0.0f;
+      }
+    return lit / 9.0f;
+  }
+  return 1.0f;
+}
+
+void main()
+{
+  int cascade;
+  const float shadow = shadowFactor(cascade);
 
   const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
   const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
@@ -46,4 +74,11 @@ void main()
   const float ambient = 0.05;
   // Light formula is pretty arbitrary and most definitely wrong
   out_fragColor = (lightColor * shadow + ambient) * vec4(params.baseColor, 1.0f);
+
+  if (params.showCascades && cascade < SHADOW_CASCADE_COUNT)
+  {
+    const vec3 cascadeColors[4] = vec3[](
+      vec3(1.0f, 0.3f, 0.3f), vec3(0.3f, 1.0f, 0.3f), vec3(0.3f, 0.3f, 1.0f), vec3(1.0f, 1.0f, 0.3f));
+    out_fragColor.rgb *= cascadeColors[cascade % 4];
+  }
 }
@@ -3,7 +3,26 @@
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/OneShotCmdMgr.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+
+#include "render_utils/Barriers.hpp"
+#include "render_utils/Frustum.hpp"
+
+namespace
+{
+
+struct LodPushConstants
+{
+  std::uint32_t lod;
+  std::uint32_t firstBlade;
+};
+
+constexpr std::array<std::uint32_t, GRASS_LOD_COUNT> LOD_VERTEX_COUNTS{
+  GRASS_NEAR_VERTICES, GRASS_MID_VERTICES, GRASS_FAR_VERTICES};
+
+} // namespace
 
 GrassRenderer::GrassRenderer() {}
 
@@ -24,15 +43,65 @@ void GrassRenderer::allocateResources(
 
   auto& ctx = etna::get_context();
 
-  // Buffer for grass blades
-  bladesBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(Blade) * MAX_BLADES,
-    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
+  windSampler = etna::Sampler(etna::Sampler::CreateInfo{
+    .addressMode = vk::SamplerAddressMode::eRepeat,
+    .name = "grass_wind_sampler",
+  });
+
+  tilePoolBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(Blade) * MAX_TILE_SLOTS * GRASS_TILE_BLADES,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "grass_tile_pool",
+  });
+
+  tileRequestBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(GrassTileRequest) * MAX_TILE_GENERATIONS_PER_FRAME * FRAME_RING,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "grass_tile_requests",
+  });
+  tileRequestMapping = tileRequestBuffer.map();
+
+  visibleTileBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * MAX_TILE_SLOTS * FRAME_RING,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
     .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "grass_visible_tiles",
+  });
+  visibleTileMapping = visibleTileBuffer.map();
+
+  tileSlots.assign(MAX_TILE_SLOTS, TileSlot{});
+  invalidateTiles();
+
+  // Buffer for the grass blades that survive culling
+  bladesBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(GrassRenderBlade) * MAX_BLADES * GRASS_LOD_COUNT,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "grass_blades",
   });
 
+  drawArgsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(GrassDrawArgs) * GRASS_LOD_COUNT,
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+      vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "grass_draw_args",
+  });
+
+  statsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(GrassDrawArgs) * GRASS_LOD_COUNT,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "grass_stats",
+  });
+  statsMapping = statsBuffer.map();
+  std::memset(statsMapping, 0, sizeof(GrassDrawArgs) * GRASS_LOD_COUNT);
+
   // Buffer for grass generation params
   grassParamsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
     .size = sizeof(GrassParams),
@@ -47,6 +116,7 @@ void GrassRenderer::allocateResources(
 void GrassRenderer::loadShaders()
 {
   etna::create_program("grass_gen", {GRASS_RENDERER_SHADERS_ROOT "grass_gen.comp.spv"});
+  etna::create_program("grass_cull", {GRASS_RENDERER_SHADERS_ROOT "grass_cull.comp.spv"});
   etna::create_program("grass_render",
     {GRASS_RENDERER_SHADERS_ROOT "grass.vert.spv",
     GRASS_RENDERER_SHADERS_ROOT "grass.frag.spv"});
@@ -56,6 +126,7 @@ void GrassRenderer::setupPipelines(vk::Format swapchain_format) {
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
   grassGenPipeline = pipelineManager.createComputePipeline("grass_gen", {});
+  grassCullPipeline = pipelineManager.createComputePipeline("grass_cull", {});
 
   grassRenderPipeline = pipelineManager.createGraphicsPipeline(
     "grass_render",
@@ -74,9 +145,12 @@ void GrassRenderer::setupPipelines(vk::Format swapchain_format) {
     });
 }
 
-void GrassRenderer::update(const glm::vec3& in_camera_pos)
+void GrassRenderer::update(const glm::vec3& in_camera_pos, const glm::mat4& in_view_proj)
 {
   this->camera_pos = in_camera_pos;
+  // Same blade spacing as a grid of grassDensity * 100 blades across the grass radius
+  bladeSpacing = grassRadius * 2.0f / std::max(std::sqrt(grassDensity * 100.0f), 1.0f);
+
   GrassParams params;
   params.eyePos       = in_camera_pos;
   params.terrainSize  = terrain_size;
@@ -84,8 +158,170 @@ void GrassRenderer::update(const glm::vec3& in_camera_pos)
   params.grassDensity = static_cast<float>(grassDensity);
   params.grassRadius  = grassRadius;
   params.grassWidth   = grassWidth;
-  bladeCount = static_cast<std::uint32_t>(grassDensity * 100.0f);
+  extract_frustum_planes(in_view_proj, params.frustumPlanes);
+  params.maxBlades    = MAX_BLADES;
+  params.bladeSpacing = bladeSpacing;
+  params.lodNearDistance = grassRadius * lodNearFraction;
+  params.lodMidDistance  = grassRadius * std::max(lodMidFraction, lodNearFraction);
+  params.farDensity      = std::clamp(farDensity, 0.01f, 1.0f);
   std::memcpy(grassParamsMapping, &params, sizeof(GrassParams));
+
+  updateTiles(params.frustumPlanes);
+
+  std::array<GrassDrawArgs, GRASS_LOD_COUNT> stats;
+  std::memcpy(stats.data(), statsMapping, sizeof(stats));
+  visibleBladeCount = 0;
+  for (std::uint32_t lod = 0; lod < GRASS_LOD_COUNT; ++lod)
+  {
+    visibleLodBladeCounts[lod] = stats[lod].vertexCount / LOD_VERTEX_COUNTS[lod];
+    visibleBladeCount += visibleLodBladeCounts[lod];
+  }
+}
+
+std::uint64_t GrassRenderer::tileKey(glm::ivec2 coord)
+{
+  return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(coord.x)) << 32) |
+    static_cast<std::uint32_t>(coord.y);
+}
+
+void GrassRenderer::invalidateTiles()
+{
+  tileLookup.clear();
+  freeTileSlots.clear();
+  for (std::uint32_t slot = MAX_TILE_SLOTS; slot-- > 0;)
+  {
+    tileSlots[slot] = TileSlot{};
+    freeTileSlots.push_back(slot);
+  }
+}
+
+void GrassRenderer::setHeightMap(const etna::Image& height_map_image)
+{
+  if (&height_map_image == height_map)
+    return;
+  height_map = &height_map_image;
+  invalidateTiles();
+}
+
+std::uint32_t GrassRenderer::acquireTileSlot()
+{
+  if (!freeTileSlots.empty())
+  {
+    const std::uint32_t slot = freeTileSlots.back();
+    freeTileSlots.pop_back();
+    return slot;
+  }
+
+  // Evict the least recently used tile, tiles used this frame are never picked
+  std::uint32_t victim = 0;
+  for (std::uint32_t slot = 1; slot < MAX_TILE_SLOTS; ++slot)
+    if (tileSlots[slot].lastUsedFrame < tileSlots[victim].lastUsedFrame)
+      victim = slot;
+
+  tileLookup.erase(tileKey(tileSlots[victim].coord));
+  tileSlots[victim].resident = false;
+  return victim;
+}
+
+void GrassRenderer::updateTiles(const glm::vec4 (&frustum_planes)[6])
+{
+  ++frameIndex;
+  tileRequests.clear();
+  visibleTileSlots.clear();
+
+  // Placement depends on the spacing, a new one makes every cached tile stale
+  if (bladeSpacing != tileBladeSpacing)
+  {
+    invalidateTiles();
+    tileBladeSpacing = bladeSpacing;
+  }
+
+  const float tileSize = bladeSpacing * GRASS_TILE_BLADES_SIDE;
+  const glm::vec2 terrainOffset{GRASS_TERRAIN_OFFSET_X, GRASS_TERRAIN_OFFSET_Z};
+  const glm::vec2 eye = glm::vec2(camera_pos.x, camera_pos.z) - terrainOffset;
+  const float halfTerrain = terrain_size * 0.5f;
+
+  // Tiles are addressed in terrain space, only the ones touching both the grass circle and the terrain are needed
+  const glm::ivec2 minTile(glm::floor(glm::max(eye - grassRadius, glm::vec2(-halfTerrain)) / tileSize));
+  const glm::ivec2 maxTile(glm::floor(glm::min(eye + grassRadius, glm::vec2(halfTerrain)) / tileSize));
+
+  struct NeededTile
+  {
+    glm::ivec2 coord;
+    float distance;
+  };
+  std::vector<NeededTile> neededTiles;
+  for (int z = minTile.y; z <= maxTile.y; ++z)
+    for (int x = minTile.x; x <= maxTile.x; ++x)
+    {
+      const glm::vec2 tileMin = glm::vec2(x, z) * tileSize;
+      const glm::vec2 closest = glm::clamp(eye, tileMin, tileMin + tileSize);
+      const float distance = glm::distance(closest, eye);
+      if (distance <= grassRadius)
+        neededTiles.push_back(NeededTile{{x, z}, distance});
+    }
+
+  // Nearest tiles win when the pool or the generation budget runs out
+  std::sort(neededTiles.begin(), neededTiles.end(), [](const NeededTile& a, const NeededTile& b) {
+    return a.distance < b.distance;
+  });
+  if (neededTiles.size() > MAX_TILE_SLOTS)
+    neededTiles.resize(MAX_TILE_SLOTS);
+  bladeCount = static_cast<std::uint32_t>(neededTiles.size()) * GRASS_TILE_BLADES;
+
+  for (const NeededTile& tile : neededTiles)
+  {
+    std::uint32_t slot;
+    if (auto it = tileLookup.find(tileKey(tile.coord)); it != tileLookup.end())
+      slot = it->second;
+    else
+    {
+      if (tileRequests.size() >= MAX_TILE_GENERATIONS_PER_FRAME)
+        continue;
+
+      slot = acquireTileSlot();
+      tileSlots[slot].coord = tile.coord;
+      tileSlots[slot].resident = true;
+      tileLookup.emplace(tileKey(tile.coord), slot);
+      tileRequests.push_back(GrassTileRequest{
+        .tileX = static_cast<std::uint32_t>(tile.coord.x),
+        .tileZ = static_cast<std::uint32_t>(tile.coord.y),
+        .slot = slot,
+        .pad = 0,
+      });
+    }
+    tileSlots[slot].lastUsedFrame = frameIndex;
+
+    // Wind bends blades sideways by up to their height
+    const glm::vec2 tileMin = glm::vec2(tile.coord) * tileSize + terrainOffset - grassHeight;
+    const glm::vec2 tileMax = tileMin + tileSize + 2.0f * grassHeight;
+    // Clumps make blades up to 1.5 times taller than grassHeight
+    const TerrainHeightRange heights = terrain_renderer != nullptr
+      ? terrain_renderer->queryHeightRange(tileMin, tileMax)
+      : TerrainHeightRange{TERRAIN_HEIGHT_MIN * GRASS_TERRAIN_HEIGHT_SCALE, TERRAIN_HEIGHT_MAX * GRASS_TERRAIN_HEIGHT_SCALE};
+    const float minY = GRASS_TERRAIN_OFFSET_Y + heights.min;
+    const float maxY = GRASS_TERRAIN_OFFSET_Y + heights.max + 1.5f * grassHeight;
+    const bool visible = std::ranges::all_of(frustum_planes, [&](const glm::vec4& plane) {
+      const glm::vec3 farthest{
+        plane.x >= 0.0f ? tileMax.x : tileMin.x,
+        plane.y >= 0.0f ? maxY : minY,
+        plane.z >= 0.0f ? tileMax.y : tileMin.y,
+      };
+      return glm::dot(glm::vec3(plane), farthest) + plane.w >= 0.0f;
+    });
+    if (visible)
+      visibleTileSlots.push_back(slot);
+  }
+
+  frameSection = (frameSection + 1) % FRAME_RING;
+  std::memcpy(
+    static_cast<GrassTileRequest*>(tileRequestMapping) + frameSection * MAX_TILE_GENERATIONS_PER_FRAME,
+    tileRequests.data(),
+    tileRequests.size() * sizeof(GrassTileRequest));
+  std::memcpy(
+    static_cast<std::uint32_t*>(visibleTileMapping) + frameSection * MAX_TILE_SLOTS,
+    visibleTileSlots.data(),
+    visibleTileSlots.size() * sizeof(std::uint32_t));
 }
 
 void GrassRenderer::render(vk::CommandBuffer cmd_buf) {
@@ -100,7 +336,7 @@ void GrassRenderer::render(vk::CommandBuffer cmd_buf) {
         etna::Binding{0, bladesBuffer.genBinding()},
         etna::Binding{2, constants->genBinding()},
         etna::Binding{3, grassParamsBuffer.genBinding()},
-        etna::Binding{4, wind_map->genBinding(default_sampler->get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+        etna::Binding{4, wind_map->genBinding(windSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
         etna::Binding{5, uniform_params_buffer->genBinding()},
       });
     cmd_buf.bindDescriptorSets(
@@ -108,31 +344,104 @@ void GrassRenderer::render(vk::CommandBuffer cmd_buf) {
       {descSet.getVkSet()}, {});
   }
 
-  cmd_buf.draw(bladeCount * 6, 1, 0, 0);
+  // Every LOD band is a separate draw over its own section of the culled blades
+  for (std::uint32_t lod = 0; lod < GRASS_LOD_COUNT; ++lod)
+  {
+    const LodPushConstants pushConstants{.lod = lod, .firstBlade = lod * MAX_BLADES};
+    cmd_buf.pushConstants(
+      grassRenderPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(pushConstants), &pushConstants);
+    cmd_buf.drawIndirect(drawArgsBuffer.get(), lod * sizeof(GrassDrawArgs), 1, 0);
+  }
 }
 
 void GrassRenderer::generateGrass(vk::CommandBuffer cmd_buf) {
-  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, grassGenPipeline.getVkPipeline());
+  // The previous frame must be done culling and drawing before the pool and the blades are overwritten
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eDrawIndirect |
+      vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer,
+    {},
+    vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+    {});
 
-  auto shaderInfo = etna::get_shader_program("grass_gen");
-  if (shaderInfo.isDescriptorSetUsed(0)) {
+  // Tiles that just entered the grass radius
+  if (!tileRequests.empty())
+  {
+    auto shaderInfo = etna::get_shader_program("grass_gen");
     auto descSet = etna::create_descriptor_set(
       shaderInfo.getDescriptorLayoutId(0),
       cmd_buf,
       {
-        etna::Binding{0, bladesBuffer.genBinding()},
+        etna::Binding{0, tilePoolBuffer.genBinding()},
         etna::Binding{1, height_map->genBinding(default_sampler->get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
         etna::Binding{2, grassParamsBuffer.genBinding()},
+        etna::Binding{3, tileRequestBuffer.genBinding()},
       });
+
+    const std::uint32_t firstRequest = frameSection * MAX_TILE_GENERATIONS_PER_FRAME;
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, grassGenPipeline.getVkPipeline());
     cmd_buf.bindDescriptorSets(
       vk::PipelineBindPoint::eCompute, grassGenPipeline.getVkPipelineLayout(), 0,
       {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      grassGenPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(firstRequest), &firstRequest);
+    cmd_buf.dispatch(GRASS_TILE_BLADES / GRASS_WORKGROUP_SIZE, static_cast<std::uint32_t>(tileRequests.size()), 1);
+  }
+
+  std::array<GrassDrawArgs, GRASS_LOD_COUNT> emptyArgs;
+  emptyArgs.fill(GrassDrawArgs{.vertexCount = 0, .instanceCount = 1, .firstVertex = 0, .firstInstance = 0});
+  cmd_buf.updateBuffer(drawArgsBuffer.get(), 0, sizeof(emptyArgs), emptyArgs.data());
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eShaderWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite);
+
+  // Per-blade culling of the resident tiles in view
+  if (!visibleTileSlots.empty())
+  {
+    auto shaderInfo = etna::get_shader_program("grass_cull");
+    auto descSet = etna::create_descriptor_set(
+      shaderInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, tilePoolBuffer.genBinding()},
+        etna::Binding{1, visibleTileBuffer.genBinding()},
+        etna::Binding{2, grassParamsBuffer.genBinding()},
+        etna::Binding{3, drawArgsBuffer.genBinding()},
+        etna::Binding{4, bladesBuffer.genBinding()},
+      });
+
+    const std::uint32_t firstTile = frameSection * MAX_TILE_SLOTS;
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, grassCullPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, grassCullPipeline.getVkPipelineLayout(), 0,
+      {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      grassCullPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(firstTile), &firstTile);
+    cmd_buf.dispatch(GRASS_TILE_BLADES / GRASS_WORKGROUP_SIZE, static_cast<std::uint32_t>(visibleTileSlots.size()), 1);
   }
 
-  std::uint32_t gridSize = static_cast<uint32_t>(ceil(sqrt(static_cast<double>(bladeCount))));
-  groupCountX = (gridSize + 31) / 32;
-  groupCountY = (gridSize + 31) / 32;
-  cmd_buf.dispatch(groupCountX, groupCountY, 1);
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite,
+    vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eDrawIndirect |
+      vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eIndirectCommandRead |
+      vk::AccessFlagBits2::eTransferRead);
+  cmd_buf.copyBuffer(
+    drawArgsBuffer.get(), statsBuffer.get(), {vk::BufferCopy{0, 0, sizeof(GrassDrawArgs) * GRASS_LOD_COUNT}});
+}
+
+std::size_t GrassRenderer::getBufferMemoryBytes() const
+{
+  return sizeof(Blade) * MAX_TILE_SLOTS * GRASS_TILE_BLADES +
+    sizeof(GrassRenderBlade) * MAX_BLADES * GRASS_LOD_COUNT +
+    sizeof(GrassTileRequest) * MAX_TILE_GENERATIONS_PER_FRAME * FRAME_RING +
+    sizeof(std::uint32_t) * MAX_TILE_SLOTS * FRAME_RING +
+    sizeof(GrassDrawArgs) * GRASS_LOD_COUNT * 2 + sizeof(GrassParams);
 }
 
 void GrassRenderer::setGrassDensity(int density)
@@ -1,14 +1,19 @@
 #pragma once
 
-#include "TerrainRenderer.hpp"
+#include "terrain/TerrainRenderer.hpp"
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
 #include <etna/GraphicsPipeline.hpp>
 #include <etna/ComputePipeline.hpp>
 #include <glm/glm.hpp>
+#include <array>
+#include <unordered_map>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
+#include "shaders/UniformParams.h"
+
 struct Blade {
   glm::vec3 pos;
   float height;
@@ -21,11 +26,46 @@ struct GrassParams {
   float grassDensity;
   float grassRadius;
   float grassWidth;
+  // Normalized view frustum planes, inside where dot(plane.xyz, p) + plane.w >= 0
+  glm::vec4 frustumPlanes[6];
+  std::uint32_t maxBlades;
+  // Distance between neighbouring blades, tiles are GRASS_TILE_BLADES_SIDE blades wide
+  float bladeSpacing;
+  // Ends of the near and mid LOD bands, density starts to fall off past the near one
+  float lodNearDistance;
+  float lodMidDistance;
+  // Fraction of the blades kept at grassRadius
+  float farDensity;
+};
+
+// Culled blade as drawn, width grows where density is thinned out
+struct GrassRenderBlade {
+  glm::vec3 pos;
+  std::uint32_t heightWidth; // packHalf2x16
+};
+
+// Filled by grass_cull.comp, consumed by drawIndirect
+struct GrassDrawArgs {
+  std::uint32_t vertexCount;
+  std::uint32_t instanceCount;
+  std::uint32_t firstVertex;
+  std::uint32_t firstInstance;
 };
 
+/**
+ * Grass placement lives in world-space tiles cached in a GPU tile pool.
+ * Tiles entering the grass radius are generated once, the least recently
+ * used ones are evicted when the pool is full. Every frame only the resident
+ * tiles in view are culled blade by blade into a compacted buffer which is
+ * drawn indirectly, and placement does not move with the camera.
+ */
 class GrassRenderer
 {
 public:
+  static constexpr std::uint32_t MAX_TILE_SLOTS = 2048;
+  // New tiles beyond this are generated over the next frames
+  static constexpr std::uint32_t MAX_TILE_GENERATIONS_PER_FRAME = 64;
+
   explicit GrassRenderer();
 
   void allocateResources(
@@ -37,30 +77,75 @@ public:
     float              in_terrain_size);
   void loadShaders();
   void setupPipelines(vk::Format swapchain_format);
-  void update(const glm::vec3& in_camera_pos);
+  void update(const glm::vec3& in_camera_pos, const glm::mat4& in_view_proj);
   void render(vk::CommandBuffer cmd_buf);
 
+  // Generates tiles that entered the view radius and culls the visible ones
   void generateGrass  (vk::CommandBuffer cmd_buf);
+  // Drops all cached tiles, e.g. after the terrain changed
+  void invalidateTiles();
+  // Cached tiles are dropped when the terrain switches to a different heightmap
+  void setHeightMap(const etna::Image& height_map_image);
+  // Height bounds of the terrain regions tighten the culling of the tiles
+  void setTerrain(const TerrainRenderer& terrain) { terrain_renderer = &terrain; }
   void setGrassDensity(int density);
   void setGrassHeight (float height);
   void setGrassRadius (float radius);
   void setGrassWidth  (float width);
+  // Band ends are given as fractions of the grass radius
+  void setLodNearFraction(float fraction) { lodNearFraction = fraction; }
+  void setLodMidFraction (float fraction) { lodMidFraction = fraction; }
+  void setFarDensity     (float density)  { farDensity = density; }
 
   float    getGrassHeight () const { return grassHeight;  }
   int      getGrassDensity() const { return grassDensity; }
   float    getGrassRadius () const { return grassRadius;  }
   float    getGrassWidth  () const { return grassWidth;   }
   uint32_t getBladeCount  () const { return bladeCount;   }
+  uint32_t getVisibleBladeCount() const { return visibleBladeCount; }
+  uint32_t getVisibleBladeCount(std::uint32_t lod) const { return visibleLodBladeCounts[lod]; }
+  float    getLodNearFraction() const { return lodNearFraction; }
+  float    getLodMidFraction () const { return lodMidFraction; }
+  float    getFarDensity     () const { return farDensity; }
+  // GPU memory of the tile pool and the per frame buffers, for the memory report
+  std::size_t getBufferMemoryBytes() const;
+  uint32_t getResidentTileCount() const { return static_cast<uint32_t>(tileLookup.size()); }
+  uint32_t getVisibleTileCount () const { return static_cast<uint32_t>(visibleTileSlots.size()); }
+
+private:
+  struct TileSlot
+  {
+    glm::ivec2 coord;
+    std::uint64_t lastUsedFrame = 0;
+    bool resident = false;
+  };
+
+  void updateTiles(const glm::vec4 (&frustum_planes)[6]);
+  std::uint32_t acquireTileSlot();
+  static std::uint64_t tileKey(glm::ivec2 coord);
 
 private:
 
   // Buffers
+  // Generated placement of all resident tiles
+  etna::Buffer tilePoolBuffer;
+  // Per frame tile lists, one section per frame in the ring
+  etna::Buffer tileRequestBuffer;
+  etna::Buffer visibleTileBuffer;
+  void* tileRequestMapping = nullptr;
+  void* visibleTileMapping = nullptr;
+  // Only blades that survived culling, compacted by the cull pass into
+  // one section of MAX_BLADES per LOD band, each with its own draw arguments
   etna::Buffer bladesBuffer;
+  etna::Buffer drawArgsBuffer;
+  etna::Buffer statsBuffer;
   etna::Buffer grassParamsBuffer;
   void* grassParamsMapping = nullptr;
+  void* statsMapping = nullptr;
 
   // Pipelines
   etna::ComputePipeline grassGenPipeline;
+  etna::ComputePipeline grassCullPipeline;
   etna::GraphicsPipeline grassRenderPipeline;
 
   etna::Buffer*  constants = nullptr;
@@ -68,19 +153,39 @@ private:
   etna::Sampler* default_sampler = nullptr;
   const etna::Image* height_map = nullptr;
   const etna::Image* wind_map = nullptr;
+  const TerrainRenderer* terrain_renderer = nullptr;
+  // The wind map tiles and is scrolled past the edges
+  etna::Sampler windSampler;
 
   // Parameters
   int   grassDensity = 400;
   float grassHeight  = 5.0f;
   float grassRadius  = 100.0f;
   float grassWidth   = 0.1f;
+  float lodNearFraction = 0.2f;
+  float lodMidFraction  = 0.5f;
+  float farDensity      = 0.15f;
   float terrain_size = TerrainRenderer::TERRAIN_GRID_SIZE;
 
   glm::vec3 camera_pos;
   std::uint32_t bladeCount = 100;
+  // A few frames late, read back for statistics only
+  std::uint32_t visibleBladeCount = 0;
+  std::array<std::uint32_t, GRASS_LOD_COUNT> visibleLodBladeCounts{};
+
+  // Tile cache, slots index the tile pool
+  std::vector<TileSlot> tileSlots;
+  std::vector<std::uint32_t> freeTileSlots;
+  std::unordered_map<std::uint64_t, std::uint32_t> tileLookup;
+  std::vector<GrassTileRequest> tileRequests;
+  std::vector<std::uint32_t> visibleTileSlots;
+  // Spacing the resident tiles were generated with
+  float tileBladeSpacing = 0.0f;
+  float bladeSpacing = 1.0f;
+  std::uint64_t frameIndex = 0;
+  // Sections of the per frame buffers, longer than the frames in flight
+  static constexpr std::uint32_t FRAME_RING = 3;
+  std::uint32_t frameSection = 0;
 
-  // Compute workgroup sizes
-  std::uint32_t groupCountX = 4;
-  std::uint32_t groupCountY = 4;
-  std::uint32_t MAX_BLADES = grassDensity * 10'000;
-};
\ No newline at end of file
+  static constexpr std::uint32_t MAX_BLADES = MAX_TILE_SLOTS * GRASS_TILE_BLADES;
+};
@@ -0,0 +1,108 @@
+#include "WindMap.hpp"
+
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+
+void WindMap::allocateResources(etna::Sampler& in_default_sampler)
+{
+  this->default_sampler = &in_default_sampler;
+
+  auto& ctx = etna::get_context();
+
+  windImage = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{WIND_MAP_SIZE, WIND_MAP_SIZE, 1},
+    .name = "wind_map",
+    .format = vk::Format::eR16G16Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage});
+
+  auto cmdManager = ctx.createOneShotCmdMgr();
+  auto cmdBuf = cmdManager->start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+  record(cmdBuf);
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  cmdManager->submitAndWait(cmdBuf);
+  dirty = false;
+}
+
+void WindMap::loadShaders()
+{
+  etna::create_program("wind_perlin", {GRASS_RENDERER_SHADERS_ROOT "wind_perlin.comp.spv"});
+}
+
+void WindMap::setupPipelines()
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  windPipeline = pipelineManager.createComputePipeline("wind_perlin", {});
+}
+
+void WindMap::update(vk::CommandBuffer cmd_buf)
+{
+  if (!dirty)
+    return;
+  dirty = false;
+  record(cmd_buf);
+}
+
+void WindMap::setParams(const PerlinParams& params)
+{
+  windParams = params;
+  dirty = true;
+}
+
+std::size_t WindMap::getMemoryBytes() const
+{
+  // RG16F
+  return std::size_t{WIND_MAP_SIZE} * WIND_MAP_SIZE * 4;
+}
+
+void WindMap::record(vk::CommandBuffer cmd_buf)
+{
+  etna::set_state(
+    cmd_buf,
+    windImage.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  {
+    auto windInfo = etna::get_shader_program("wind_perlin");
+
+    auto binding = windImage.genBinding(default_sampler->get(), vk::ImageLayout::eGeneral, {});
+
+    auto set = etna::create_descriptor_set(
+      windInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, binding},
+      });
+
+    vk::DescriptorSet vkSet = set.getVkSet();
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, windPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      windPipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+    // Parameters go in push constants, frames in flight may still be reading older ones
+    cmd_buf.pushConstants(
+      windPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(PerlinParams), &windParams);
+
+    cmd_buf.dispatch(WIND_MAP_SIZE / 32, WIND_MAP_SIZE / 32, 1);
+  }
+
+  etna::set_state(
+    cmd_buf,
+    windImage.get(),
+    vk::PipelineStageFlagBits2::eVertexShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vulkan/vulkan.hpp>
+
+#include "shaders/UniformParams.h"
+
+// Tiling wind map, scrolled over the terrain by the grass shader
+class WindMap
+{
+public:
+  // Creates the map and generates it right away, pipelines must be set up before
+  void allocateResources(etna::Sampler& in_default_sampler);
+  void loadShaders();
+  void setupPipelines();
+  // Rebuilds the map inside the frame if its parameters changed
+  void update(vk::CommandBuffer cmd_buf);
+
+  const etna::Image&  getImage () const { return windImage;  }
+  const PerlinParams& getParams() const { return windParams; }
+  void setParams(const PerlinParams& params);
+
+  // GPU memory of the map, for the memory report
+  std::size_t getMemoryBytes() const;
+
+  static constexpr std::uint32_t WIND_MAP_SIZE = 512;
+
+private:
+  void record(vk::CommandBuffer cmd_buf);
+
+  etna::Image windImage;
+  etna::ComputePipeline windPipeline{};
+  bool dirty = false;
+
+  PerlinParams windParams{
+    .octaves = 2u,
+    .amplitude = 0.25f,
+    .frequencyMultiplier = 1.5f,
+    .scale = 2.0f,
+    .time = 5.0f,
+  };
+
+  etna::Sampler* default_sampler = nullptr;
+};
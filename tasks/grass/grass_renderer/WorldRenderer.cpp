@@ -13,7 +13,8 @@ WorldRenderer::WorldRenderer()
   : sceneMgr{std::make_unique<SceneManager>()},
     gui{std::make_unique<WorldRendererGui>(*this)},
     terrainRenderer{std::make_unique<TerrainRenderer>()},
-    grassRenderer{std::make_unique<GrassRenderer>()}
+    grassRenderer{std::make_unique<GrassRenderer>()},
+    windMap{std::make_unique<WindMap>()}
 {
 }
 
@@ -62,9 +63,11 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
   persistentMapping = instanceMatricesBuffer.map();
 
   terrainRenderer->allocateResources(constants, uniform_params_buffer, default_sampler);
+  windMap->allocateResources(default_sampler);
   perlinParams = terrainRenderer->getPerlinParams();
-  windParams   = terrainRenderer->getWindParams  ();
-  grassRenderer->allocateResources(constants, uniform_params_buffer, default_sampler, terrainRenderer->getPerlinTerrainImage(), terrainRenderer->getWindImage(), terrainRenderer->getTerrainWorldSize());
+  windParams   = windMap->getParams();
+  grassRenderer->allocateResources(constants, uniform_params_buffer, default_sampler, terrainRenderer->getPerlinTerrainImage(), windMap->getImage(), terrainRenderer->getTerrainWorldSize());
+  grassRenderer->setTerrain(*terrainRenderer);
 }
 
 void WorldRenderer::loadScene(std::filesystem::path path)
@@ -100,6 +103,7 @@ void WorldRenderer::loadShaders()
      GRASS_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
   terrainRenderer->loadShaders();
   grassRenderer->loadShaders();
+  windMap->loadShaders();
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
@@ -137,6 +141,7 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
     });
   terrainRenderer->setupPipelines(swapchain_format);
   grassRenderer->setupPipelines(swapchain_format);
+  windMap->setupPipelines();
 }
 
 bool WorldRenderer::isVisibleBoundingBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& mvp) const
@@ -226,8 +231,10 @@ void WorldRenderer::update(const FramePacket& packet)
   constants.unmap();
 
   terrainRenderer->update(perlinParams);
-  terrainRenderer->updateWind(uniformParams.time);
-  grassRenderer->update(camView);
+  terrainRenderer->selectNodes(camView, worldViewProj);
+  // Swaps to the new heightmap once a regeneration completes
+  grassRenderer->setHeightMap(terrainRenderer->getPerlinTerrainImage());
+  grassRenderer->update(camView, worldViewProj);
 
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
   auto instanceMatricesData = sceneMgr->getInstanceMatrices();
@@ -398,6 +405,14 @@ void WorldRenderer::renderWorld(
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
+  // Terrain edits are regenerated a few tiles per frame in the background
+  terrainRenderer->updateTerrainMaps(cmd_buf);
+  // Wind is animated in the grass shader, the map itself only changes with its parameters
+  windMap->update(cmd_buf);
+
+  if (enableTerrainRendering)
+    terrainRenderer->cullPatches(cmd_buf);
+
   // Generate grass blades outside render pass
   if (enableGrassRendering)
     grassRenderer->generateGrass(cmd_buf);
@@ -480,7 +495,7 @@ const PerlinParams& WorldRenderer::getWindParams() const
 void WorldRenderer::setWindParams(const PerlinParams& params)
 {
   windParams = params;
-  terrainRenderer->setWindParams(windParams);
+  windMap->setParams(windParams);
 }
 
 void WorldRenderer::regenerateTerrain()
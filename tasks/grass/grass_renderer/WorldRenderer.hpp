@@ -9,8 +9,9 @@
 #include <glm/glm.hpp>
 #include <memory>
 
-#include "TerrainRenderer.hpp"
+#include "terrain/TerrainRenderer.hpp"
 #include "GrassRenderer.hpp"
+#include "WindMap.hpp"
 
 #include "WorldRendererGui.hpp"
 #include "shaders/UniformParams.h"
@@ -72,6 +73,7 @@ private:
   std::unique_ptr<QuadRenderer>     quadRenderer;
   std::unique_ptr<TerrainRenderer>  terrainRenderer;
   std::unique_ptr<GrassRenderer>    grassRenderer;
+  std::unique_ptr<WindMap>          windMap;
 
   // Pipelines
   etna::GraphicsPipeline staticMeshPipeline{};
@@ -2,6 +2,7 @@
 
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
 #include <imgui.h>
 #include <etna/GlobalContext.hpp>
 #include "shaders/UniformParams.h"
@@ -63,6 +64,29 @@ void WorldRendererGui::drawPerformanceTab() const
     ImGui::GetIO().Framerate);
   ImGui::Text("Rendered Instances: %u", renderer_.renderedInstances);
   ImGui::Text("Grass Blades: %u", renderer_.grassRenderer->getBladeCount());
+  ImGui::Text("Visible Grass Blades: %u", renderer_.grassRenderer->getVisibleBladeCount());
+  ImGui::Text("  Near / Mid / Far: %u / %u / %u",
+    renderer_.grassRenderer->getVisibleBladeCount(GRASS_LOD_NEAR),
+    renderer_.grassRenderer->getVisibleBladeCount(GRASS_LOD_MID),
+    renderer_.grassRenderer->getVisibleBladeCount(GRASS_LOD_FAR));
+  ImGui::Text("Resident Grass Tiles: %u", renderer_.grassRenderer->getResidentTileCount());
+  ImGui::Text("Visible Grass Tiles: %u", renderer_.grassRenderer->getVisibleTileCount());
+
+  ImGui::Separator();
+  constexpr float MIB = 1024.0f * 1024.0f;
+  const std::size_t heightBytes = renderer_.terrainRenderer->getHeightMapBytes();
+  const std::size_t normalBytes = renderer_.terrainRenderer->getNormalMapBytes();
+  const std::size_t windBytes   = renderer_.windMap->getMemoryBytes();
+  const std::size_t grassBytes  = renderer_.grassRenderer->getBufferMemoryBytes();
+  const std::size_t pageBytes   = renderer_.terrainRenderer->getVirtualHeightmap().getMemoryBytes();
+  ImGui::Text("GPU Memory");
+  ImGui::Text("  Heightmap: %.1f MiB", static_cast<float>(heightBytes) / MIB);
+  ImGui::Text("  Normal Map: %.1f MiB", static_cast<float>(normalBytes) / MIB);
+  ImGui::Text("  Wind Map: %.1f MiB", static_cast<float>(windBytes) / MIB);
+  ImGui::Text("  Grass Buffers: %.1f MiB", static_cast<float>(grassBytes) / MIB);
+  ImGui::Text("  Streamed Pages: %.1f MiB", static_cast<float>(pageBytes) / MIB);
+  ImGui::Text(
+    "  Total: %.1f MiB", static_cast<float>(heightBytes + normalBytes + windBytes + grassBytes + pageBytes) / MIB);
 }
 
 void WorldRendererGui::drawRenderTab()
@@ -91,24 +115,52 @@ void WorldRendererGui::drawTerrainTab()
   ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
   renderer_.uniformParams.lightPos = {pos[0], pos[1], pos[2]};
 
+  const char* encodings[] = {"Precise (R32F / RG16)", "Compact (R16 / RG8)"};
+  int encoding = static_cast<int>(renderer_.terrainRenderer->getTextureEncoding());
+  if (ImGui::Combo("Terrain Texture Encoding", &encoding, encodings, IM_ARRAYSIZE(encodings)))
+    renderer_.terrainRenderer->setTextureEncoding(static_cast<TerrainTextureEncoding>(encoding));
+  ImGui::Text("Terrain Maps: %s", renderer_.terrainRenderer->isLoadedFromCache() ? "loaded from cache" : "generated");
+
+  // Every size change recreates and regenerates the maps, so sizes only apply on Enter
   int width = static_cast<int>(renderer_.terrainRenderer->getTerrainTextureSizeWidth());
-  if (ImGui::InputInt("Terrain Texture Width", &width))
-    renderer_.terrainRenderer->setTerrainTextureSizeWidth(static_cast<std::uint32_t>(width));
+  if (ImGui::InputInt("Terrain Texture Width", &width, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue))
+    renderer_.terrainRenderer->setTerrainTextureSizeWidth(static_cast<std::uint32_t>(std::max(width, 1)));
 
   int height = static_cast<int>(renderer_.terrainRenderer->getTerrainTextureSizeHeight());
-  if (ImGui::InputInt("Terrain Texture Height", &height))
-    renderer_.terrainRenderer->setTerrainTextureSizeHeight(static_cast<std::uint32_t>(height));
+  if (ImGui::InputInt("Terrain Texture Height", &height, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue))
+    renderer_.terrainRenderer->setTerrainTextureSizeHeight(static_cast<std::uint32_t>(std::max(height, 1)));
 
-  int workgroup = static_cast<int>(renderer_.terrainRenderer->getComputeWorkgroupSize());
-  if (ImGui::InputInt("Compute Workgroup Size", &workgroup))
-    renderer_.terrainRenderer->setComputeWorkgroupSize(static_cast<std::uint32_t>(workgroup));
+  const char* renderModes[] = {"Tessellation", "CDLOD", "Streamed CDLOD"};
+  int renderMode = static_cast<int>(renderer_.terrainRenderer->getRenderMode());
+  if (ImGui::Combo("Terrain Render Mode", &renderMode, renderModes, IM_ARRAYSIZE(renderModes)))
+    renderer_.terrainRenderer->setRenderMode(static_cast<TerrainRenderMode>(renderMode));
 
-  int patch = static_cast<int>(renderer_.terrainRenderer->getPatchSubdivision());
-  if (ImGui::InputInt("Patch Subdivision", &patch))
-    renderer_.terrainRenderer->setPatchSubdivision(static_cast<std::uint32_t>(patch));
+  if (renderer_.terrainRenderer->getRenderMode() != TerrainRenderMode::Tessellation)
+  {
+    float detailDistance = renderer_.terrainRenderer->getCdlodDetailDistance();
+    if (ImGui::SliderFloat("CDLOD Detail Distance", &detailDistance, 16.0f, 96.0f))
+      renderer_.terrainRenderer->setCdlodDetailDistance(detailDistance);
+    ImGui::Text("CDLOD Nodes: %u", renderer_.terrainRenderer->getCdlodNodeCount());
+  }
+
+  if (renderer_.terrainRenderer->getRenderMode() == TerrainRenderMode::StreamedCdlod)
+  {
+    auto& pages = renderer_.terrainRenderer->getVirtualHeightmap();
+    int pagesPerFrame = static_cast<int>(pages.getPagesPerFrame());
+    if (ImGui::SliderInt("Pages Generated Per Frame", &pagesPerFrame, 1, 64))
+      pages.setPagesPerFrame(static_cast<std::uint32_t>(pagesPerFrame));
+    ImGui::Text("Resident Pages: %u / %u", pages.getResidentPageCount(), VirtualHeightmap::POOL_SLOTS);
+    ImGui::Text("Pending Pages: %u", pages.getPendingPageCount());
+  }
+
+  bool patchCulling = renderer_.terrainRenderer->getPatchCulling();
+  if (ImGui::Checkbox("Cull Terrain Patches", &patchCulling))
+    renderer_.terrainRenderer->setPatchCulling(patchCulling);
+  ImGui::Text(
+    "Visible Terrain Patches: %u / %u",
+    renderer_.terrainRenderer->getVisiblePatchCount(),
+    renderer_.terrainRenderer->getPatchCount());
 
-  ImGui::Text("Group Count X: %u", renderer_.terrainRenderer->getGroupCountX());
-  ImGui::Text("Group Count Y: %u", renderer_.terrainRenderer->getGroupCountY());
   ImGui::Separator();
 
   ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Perlin Noise Parameters");
@@ -123,6 +175,12 @@ void WorldRendererGui::drawTerrainTab()
 
   if (ImGui::Button("Regenerate Terrain"))
     renderer_.regenerateTerrain();
+
+  int regenerationTiles = static_cast<int>(renderer_.terrainRenderer->getRegenerationTilesPerFrame());
+  if (ImGui::SliderInt("Regeneration Tiles Per Frame", &regenerationTiles, 1, 64))
+    renderer_.terrainRenderer->setRegenerationTilesPerFrame(static_cast<std::uint32_t>(regenerationTiles));
+  if (renderer_.terrainRenderer->isRegenerating())
+    ImGui::ProgressBar(renderer_.terrainRenderer->getRegenerationProgress(), ImVec2(-1.0f, 0.0f), "Regenerating");
 }
 
 void WorldRendererGui::drawGrassTab()
@@ -162,6 +220,16 @@ void WorldRendererGui::drawGrassTab()
     oldGrassRadius = grassRadius;
   }
 
+  float lodNear = renderer_.grassRenderer->getLodNearFraction();
+  if (ImGui::SliderFloat("Near LOD Band", &lodNear, 0.0f, 1.0f))
+    renderer_.grassRenderer->setLodNearFraction(lodNear);
+  float lodMid = renderer_.grassRenderer->getLodMidFraction();
+  if (ImGui::SliderFloat("Mid LOD Band", &lodMid, 0.0f, 1.0f))
+    renderer_.grassRenderer->setLodMidFraction(lodMid);
+  float farDensity = renderer_.grassRenderer->getFarDensity();
+  if (ImGui::SliderFloat("Far Density", &farDensity, 0.01f, 1.0f))
+    renderer_.grassRenderer->setFarDensity(farDensity);
+
   ImGui::Separator();
   ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Wind Parameters");
   ImGui::SliderFloat("Wind Strength", &renderer_.uniformParams.windStrength, 0.0f, 5.0f);
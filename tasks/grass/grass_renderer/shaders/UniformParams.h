@@ -2,16 +2,47 @@
 #define UNIFORM_PARAMS_H_INCLUDED
 
 #include "cpp_glsl_compat.h"
+#include "terrain_params.h"
 
-struct PerlinParams
+// Grass placement is generated per world-space tile of GRASS_TILE_BLADES_SIDE^2 blades,
+// tiles are cached in a GPU pool and only culled and drawn every frame
+#define GRASS_TILE_BLADES_SIDE 32
+#define GRASS_TILE_BLADES      (GRASS_TILE_BLADES_SIDE * GRASS_TILE_BLADES_SIDE)
+#define GRASS_WORKGROUP_SIZE   256
+
+// Placement of the heightmap in the world, shared with the terrain shaders
+#define GRASS_TERRAIN_HEIGHT_SCALE 200.0
+#define GRASS_TERRAIN_OFFSET_X     12.0
+#define GRASS_TERRAIN_OFFSET_Y     -299.0
+#define GRASS_TERRAIN_OFFSET_Z     12.0
+
+// Blades are placed around clump centers, one clump per GRASS_CLUMP_CELLS^2 grid cells
+#define GRASS_CLUMP_CELLS 4
+
+// Distance LOD bands, picked per blade by the cull pass, every band has its own
+// compacted blade list and indirect draw
+#define GRASS_LOD_NEAR  0u // curved blade of GRASS_NEAR_SEGMENTS segments
+#define GRASS_LOD_MID   1u // single triangle
+#define GRASS_LOD_FAR   2u // card standing in for several thinned out blades
+#define GRASS_LOD_COUNT 3
+
+#define GRASS_NEAR_SEGMENTS 4
+#define GRASS_NEAR_VERTICES (GRASS_NEAR_SEGMENTS * 6 - 3) // quads and a tip triangle
+#define GRASS_MID_VERTICES  3
+#define GRASS_FAR_VERTICES  6
+// Blades a far card is drawn as
+#define GRASS_FAR_CARD_BLADES 4.0
+
+// A tile to (re)generate into a slot of the tile pool
+struct GrassTileRequest
 {
-  shader_uint octaves;
-  shader_float amplitude;
-  shader_float frequencyMultiplier;
-  shader_float scale;
-  shader_float time;
+  shader_uint tileX; // signed tile coordinates, bit cast
+  shader_uint tileZ;
+  shader_uint slot;
+  shader_uint pad;
 };
 
+// Starts with the members of TerrainAppParams, the terrain shaders read the same buffer
 struct UniformParams
 {
   shader_mat4 lightMatrix;
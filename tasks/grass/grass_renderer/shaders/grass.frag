@@ -1,15 +1,28 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "UniformParams.h"
 
 layout(location = 0) out vec4 out_fragColor;
 
 layout(location = 0) in VS_OUT {
   vec3 wPos;
   vec3 normal;
+  vec2 uv;
+  flat uint lod;
 } fs_in;
 
 void main()
 {
+  // Far cards are cut into tapering blade silhouettes
+  if (fs_in.lod == GRASS_LOD_FAR)
+  {
+    float across = fract(fs_in.uv.x * GRASS_FAR_CARD_BLADES) * 2.0 - 1.0;
+    if (abs(across) > 1.0 - fs_in.uv.y)
+      discard;
+  }
+
   const vec3 wLightPos = vec3(50, 10, 255);
   const vec3 lightColor = vec3(1.0f, 1.0f, 1.0f);
   const vec3 surfaceColor = vec3(0.0, 0.5, 0.0);
@@ -1,14 +1,18 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
-struct Blade{
+#include "UniformParams.h"
+
+struct RenderBlade {
   vec3 pos;
-  float height;
+  uint heightWidth; // packHalf2x16
 };
 
+// Visible blades only, compacted by grass_cull.comp, one section per LOD band
 layout(binding = 0, std430) readonly buffer Blades
 {
-  Blade blades[];
+  RenderBlade blades[];
 } blades;
 
 layout(std140, set = 0, binding = 2) uniform Constants
@@ -41,48 +45,83 @@ layout(std140, set = 0, binding = 5) uniform AppData
   float enableDynamicWind;
 } appData;
 
+layout(push_constant) uniform PushConstants
+{
+  uint lod;
+  uint firstBlade;
+} pc;
+
 layout(location = 0) out VS_OUT
 {
   vec3 wPos;
   vec3 normal;
+  vec2 uv;
+  flat uint lod;
 } vs_out;
 
-void main()
-{
-  uint bladeIndex    = gl_VertexIndex / 6;
-  uint vertexInBlade = gl_VertexIndex % 6;
+const vec2 QUAD_CORNERS[6] = vec2[6](
+  vec2(-1.0, 0.0), // bottom left
+  vec2( 1.0, 0.0), // bottom right
+  vec2(-1.0, 1.0), // top left
+  vec2(-1.0, 1.0), // top left again
+  vec2( 1.0, 0.0), // bottom right
+  vec2( 1.0, 1.0)  // top right
+);
 
-  vec3  bladePos    = blades.blades[bladeIndex].pos;
-  float bladeHeight = blades.blades[bladeIndex].height;
+const vec2 TRIANGLE_CORNERS[3] = vec2[3](vec2(-1.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0));
 
-  if (bladeHeight == 0.0)
+// x - side in [-1, 1], y - position along the blade in [0, 1]
+vec2 bladeCorner(uint vertexInBlade)
+{
+  if (pc.lod == GRASS_LOD_FAR)
+    return QUAD_CORNERS[vertexInBlade];
+  if (pc.lod == GRASS_LOD_MID)
+    return TRIANGLE_CORNERS[vertexInBlade];
+
+  // Tapering segments topped with a triangle
+  const float segment = 1.0 / float(GRASS_NEAR_SEGMENTS);
+  uint quad = vertexInBlade / 6u;
+  if (quad < uint(GRASS_NEAR_SEGMENTS - 1))
   {
-    gl_Position = vec4(0.0, 0.0, 0.0, 0.0);
-    return;
+    vec2 corner = QUAD_CORNERS[vertexInBlade % 6u];
+    float along = (float(quad) + corner.y) * segment;
+    return vec2(corner.x * (1.0 - along), along);
   }
+  vec2 corner = TRIANGLE_CORNERS[vertexInBlade - uint(GRASS_NEAR_SEGMENTS - 1) * 6u];
+  float along = 1.0 - segment + corner.y * segment;
+  return vec2(corner.x * (1.0 - along), along);
+}
+
+void main()
+{
+  uint vertexCount = uint(pc.lod == GRASS_LOD_NEAR ? GRASS_NEAR_VERTICES :
+    (pc.lod == GRASS_LOD_MID ? GRASS_MID_VERTICES : GRASS_FAR_VERTICES));
+  uint bladeIndex    = pc.firstBlade + gl_VertexIndex / vertexCount;
+  uint vertexInBlade = gl_VertexIndex % vertexCount;
+
+  vec3  bladePos    = blades.blades[bladeIndex].pos;
+  vec2  heightWidth = unpackHalf2x16(blades.blades[bladeIndex].heightWidth);
+  float bladeHeight = heightWidth.x;
 
   vec3 dir = normalize(bladePos - constants.camView.xyz);
   vec3 right = normalize(cross(dir, vec3(0, 1, 0)));
   vec3 up = normalize(cross(right, dir));
 
-  float halfWidth = params.grassWidth * 0.5;
-
-  vec3 offsets[6] = vec3[6](
-    -right * halfWidth,                    // bottom left
-    right  * halfWidth,                    // bottom right
-    -right * halfWidth + up * bladeHeight, // top left
-    -right * halfWidth + up * bladeHeight, // top left again
-    right  * halfWidth,                    // bottom right
-    right  * halfWidth + up * bladeHeight  // top right
-  );
+  // Far cards stand in for several blades side by side
+  float halfWidth = heightWidth.y * 0.5;
+  if (pc.lod == GRASS_LOD_FAR)
+    halfWidth *= GRASS_FAR_CARD_BLADES;
 
-  vec3 vertexPos = bladePos + offsets[vertexInBlade];
+  vec2 corner = bladeCorner(vertexInBlade);
+  vec3 vertexPos = bladePos + right * corner.x * halfWidth + up * corner.y * bladeHeight;
 
-  // Sample wind
-  vec2  windTexCoord = (bladePos.xz / params.terrainSize) * 0.5 + 0.5;
+  // Sample wind, the bend grows quadratically along the blade so segmented blades curve.
+  // The wind map tiles, scrolling it in a circle animates the gusts
+  vec2  windScroll   = vec2(cos(appData.time * 2.0), sin(appData.time * 2.0)) * 0.5;
+  vec2  windTexCoord = (bladePos.xz / params.terrainSize) * 0.5 + 0.5 + windScroll;
   vec2  windDir      = texture(windMap, windTexCoord).xy;
   float windFactor   = sin(appData.time * appData.windSpeed + bladePos.x * 0.01 + bladePos.z * 0.01) * 0.5 + 0.5;
-  float heightFactor = offsets[vertexInBlade].y / bladeHeight;
+  float heightFactor = corner.y * corner.y;
   vec3  windOffset   = vec3(windDir.x, 0.0, windDir.y) * appData.windStrength * windFactor * heightFactor;
 
   if (appData.enableDynamicWind > 0.5)
@@ -90,5 +129,7 @@ void main()
 
   vs_out.wPos = vertexPos;
   vs_out.normal = normalize(cross(up, right));
+  vs_out.uv = vec2(corner.x * 0.5 + 0.5, corner.y);
+  vs_out.lod = pc.lod;
   gl_Position = constants.viewProj * vec4(vertexPos, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+#include "noise/TerrainNoise.hpp"
+
+
+// Bakes the grass_renderer terrain heightmap on the CPU. Heights are written either as a
+// 16-bit binary PGM holding the same unorm encoding as the compact GPU heightmap,
+// or as raw little-endian floats before encoding.
+
+namespace
+{
+
+// Same range as TERRAIN_HEIGHT_MIN and TERRAIN_HEIGHT_MAX in grass_renderer
+constexpr float HEIGHT_MIN = 0.5f;
+constexpr float HEIGHT_MAX = 1.5f;
+
+struct Options
+{
+  const char* output = nullptr;
+  std::uint32_t width = 4096;
+  std::uint32_t height = 4096;
+  std::uint32_t threads = 0;
+  bool rawFloats = false;
+  TerrainNoiseParams noise;
+};
+
+void print_usage()
+{
+  std::fprintf(
+    stderr,
+    "usage: terrain_baker <output> [--size <width> <height>] [--octaves <n>] [--amplitude <a>]\n"
+    "                     [--frequency-multiplier <f>] [--scale <s>] [--threads <n>] [--float]\n"
+    "Writes a 16-bit PGM, or raw 32-bit floats with --float\n");
+}
+
+bool parse_options(int argc, char** argv, Options& options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--size" && i + 2 < argc)
+    {
+      options.width = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      options.height = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    }
+    else if (arg == "--octaves" && hasValue)
+      options.noise.octaves = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--amplitude" && hasValue)
+      options.noise.amplitude = std::strtof(argv[++i], nullptr);
+    else if (arg == "--frequency-multiplier" && hasValue)
+      options.noise.frequencyMultiplier = std::strtof(argv[++i], nullptr);
+    else if (arg == "--scale" && hasValue)
+      options.noise.scale = std::strtof(argv[++i], nullptr);
+    else if (arg == "--threads" && hasValue)
+      options.threads = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--float")
+      options.rawFloats = true;
+    else if (!arg.starts_with("--") && options.output == nullptr)
+      options.output = argv[i];
+    else
+      return false;
+  }
+  return options.output != nullptr && options.width > 0 && options.height > 0 && options.noise.octaves > 0;
+}
+
+bool write_pgm(const char* path, const std::vector<float>& heights, std::uint32_t width, std::uint32_t height)
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  file << "P5\n" << width << " " << height << "\n65535\n";
+  std::vector<unsigned char> row(2 * static_cast<std::size_t>(width));
+  for (std::uint32_t y = 0; y < height; ++y)
+  {
+    for (std::uint32_t x = 0; x < width; ++x)
+    {
+      const float unorm = (heights[static_cast<std::size_t>(y) * width + x] - HEIGHT_MIN) / (HEIGHT_MAX - HEIGHT_MIN);
+      const auto value = static_cast<std::uint16_t>(std::lround(std::clamp(unorm, 0.0f, 1.0f) * 65535.0f));
+      // PGM samples are big-endian
+      row[2 * x] = static_cast<unsigned char>(value >> 8);
+      row[2 * x + 1] = static_cast<unsigned char>(value & 0xFF);
+    }
+    file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+  }
+  return static_cast<bool>(file);
+}
+
+bool write_floats(const char* path, const std::vector<float>& heights)
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  file.write(reinterpret_cast<const char*>(heights.data()), static_cast<std::streamsize>(heights.size() * sizeof(float)));
+  return static_cast<bool>(file);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!parse_options(argc, argv, options))
+  {
+    print_usage();
+    return 1;
+  }
+
+  std::vector<float> heights(static_cast<std::size_t>(options.width) * options.height);
+
+  const auto start = std::chrono::steady_clock::now();
+  bake_terrain_heights(heights, options.width, options.height, options.noise, options.threads);
+  const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+
+  std::printf(
+    "Baked %ux%u heights in %.1f ms (%s)\n",
+    options.width,
+    options.height,
+    elapsed.count(),
+    terrain_noise_uses_avx2() ? "AVX2" : "scalar");
+
+  const bool written =
+    options.rawFloats ? write_floats(options.output, heights) : write_pgm(options.output, heights, options.width, options.height);
+  if (!written)
+  {
+    std::fprintf(stderr, "Failed to write %s\n", options.output);
+    return 1;
+  }
+  return 0;
+}
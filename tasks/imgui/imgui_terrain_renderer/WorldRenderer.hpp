@@ -11,6 +11,7 @@
 
 #include "WorldRendererGui.hpp"
 #include "shaders/UniformParams.h"
+#include "terrain/TerrainRenderer.hpp"
 #include "scene/SceneManager.hpp"
 #include "wsi/Keyboard.hpp"
 #include "render_utils/QuadRenderer.hpp"
@@ -54,9 +55,6 @@ public:
 private:
   void renderScene(
     vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
-  void createTerrainMap(vk::CommandBuffer cmd_buf);
-  void renderTerrain(vk::CommandBuffer cmd_buf);
-  void reallocateTerrainResources();
   void regenerateTerrain();
 
   bool isVisibleBoundingBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& mvp) const;
@@ -66,29 +64,23 @@ private:
   std::unique_ptr<SceneManager> sceneMgr;
   std::unique_ptr<WorldRendererGui> gui;
   std::unique_ptr<QuadRenderer> quadRenderer;
+  std::unique_ptr<TerrainRenderer> terrainRenderer;
 
   // Pipelines
   etna::GraphicsPipeline staticMeshPipeline{};
-  etna::GraphicsPipeline terrainPipeline{};
-  etna::ComputePipeline perlinPipeline{};
-  etna::ComputePipeline normalPipeline{};
 
   // Images and textures
   etna::Image mainViewDepth;
-  etna::Image perlinTerrainImage;
-  etna::Image normalMapTerrainImage;
   etna::Sampler defaultSampler;
 
   // Buffers
   etna::Buffer instanceMatricesBuffer;
   etna::Buffer constants;
   etna::Buffer uniformParamsBuffer;
-  etna::Buffer perlinValuesBuffer;
 
   // Buffer mappings
   void* persistentMapping = nullptr;
   void* uniformMapping = nullptr;
-  void* perlinValuesMapping = nullptr;
 
   // Instance data
   std::vector<InstanceGroup> instanceGroups;
@@ -103,14 +95,6 @@ private:
   float farPlane;
   CameraSpeedLevel cameraSpeedLevel = CameraSpeedLevel::Fast;
 
-  // Terrain parameters
-  std::uint32_t terrainTextureSizeWidth  = 4096;
-  std::uint32_t terrainTextureSizeHeight = 4096;
-  std::uint32_t computeWorkgroupSize = 32;
-  std::uint32_t patchSubdivision = 8;
-  std::uint32_t groupCountX;
-  std::uint32_t groupCountY;
-
   struct WorldRendererConstants{
     glm::mat4 viewProj;
     glm::vec4 camView;
@@ -129,6 +113,7 @@ private:
     .amplitude = 0.5f,
     .frequencyMultiplier = 2.0f,
     .scale = 8.0f,
+    .time = 0.0f,
   };
 
   // Render toggles
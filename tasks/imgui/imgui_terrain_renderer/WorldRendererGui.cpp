@@ -2,6 +2,7 @@
 
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
 #include <imgui.h>
 #include <etna/GlobalContext.hpp>
 #include "shaders/UniformParams.h"
@@ -56,6 +57,9 @@ void WorldRendererGui::drawPerformanceTab() const
     1000.0f / ImGui::GetIO().Framerate,
     ImGui::GetIO().Framerate);
   ImGui::Text("Rendered Instances: %u", renderer_.renderedInstances);
+  ImGui::Text(
+    "Terrain GPU Memory: %.1f MiB",
+    static_cast<float>(renderer_.terrainRenderer->getMemoryBytes()) / (1024.0f * 1024.0f));
 }
 
 void WorldRendererGui::drawRenderTab()
@@ -90,14 +94,20 @@ void WorldRendererGui::drawTerrainTab()
   ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
   renderer_.uniformParams.lightPos = {pos[0], pos[1], pos[2]};
 
-  ImGui::InputInt("Terrain Texture Width", reinterpret_cast<int*>(&renderer_.terrainTextureSizeWidth));
-  ImGui::InputInt("Terrain Texture Height", reinterpret_cast<int*>(&renderer_.terrainTextureSizeHeight));
-  ImGui::InputInt("Compute Workgroup Size", reinterpret_cast<int*>(&renderer_.computeWorkgroupSize));
-  ImGui::InputInt("Patch Subdivision", reinterpret_cast<int*>(&renderer_.patchSubdivision));
-  renderer_.groupCountX = (renderer_.terrainTextureSizeWidth + renderer_.computeWorkgroupSize - 1) / renderer_.computeWorkgroupSize;
-  renderer_.groupCountY = (renderer_.terrainTextureSizeHeight + renderer_.computeWorkgroupSize - 1) / renderer_.computeWorkgroupSize;
-  ImGui::Text("Group Count X: %u", renderer_.groupCountX);
-  ImGui::Text("Group Count Y: %u", renderer_.groupCountY);
+  // Every size change recreates and regenerates the maps, so sizes only apply on Enter
+  int width = static_cast<int>(renderer_.terrainRenderer->getTerrainTextureSizeWidth());
+  if (ImGui::InputInt("Terrain Texture Width", &width, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue))
+    renderer_.terrainRenderer->setTerrainTextureSizeWidth(static_cast<std::uint32_t>(std::max(width, 1)));
+
+  int height = static_cast<int>(renderer_.terrainRenderer->getTerrainTextureSizeHeight());
+  if (ImGui::InputInt("Terrain Texture Height", &height, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue))
+    renderer_.terrainRenderer->setTerrainTextureSizeHeight(static_cast<std::uint32_t>(std::max(height, 1)));
+
+  const char* renderModes[] = {"Tessellation", "CDLOD", "Streamed CDLOD"};
+  int renderMode = static_cast<int>(renderer_.terrainRenderer->getRenderMode());
+  if (ImGui::Combo("Terrain Render Mode", &renderMode, renderModes, IM_ARRAYSIZE(renderModes)))
+    renderer_.terrainRenderer->setRenderMode(static_cast<TerrainRenderMode>(renderMode));
+
   ImGui::Separator();
 
   ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Perlin Noise Parameters");
@@ -108,6 +118,8 @@ void WorldRendererGui::drawTerrainTab()
 
   if (ImGui::Button("Regenerate Terrain"))
     renderer_.regenerateTerrain();
+  if (renderer_.terrainRenderer->isRegenerating())
+    ImGui::ProgressBar(renderer_.terrainRenderer->getRegenerationProgress(), ImVec2(-1.0f, 0.0f), "Regenerating");
 }
 
 void WorldRendererGui::drawInfoTab() const
@@ -2,15 +2,9 @@
 #define UNIFORM_PARAMS_H_INCLUDED
 
 #include "cpp_glsl_compat.h"
+#include "terrain_params.h"
 
-struct PerlinParams
-{
-  shader_uint octaves;
-  shader_float amplitude;
-  shader_float frequencyMultiplier;
-  shader_float scale;
-};
-
+// Starts with the members of TerrainAppParams, the terrain shaders read the same buffer
 struct UniformParams
 {
   shader_mat4 lightMatrix;
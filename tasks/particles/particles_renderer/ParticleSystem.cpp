@@ -1,6 +1,7 @@
 #include "ParticleSystem.hpp"
 
 #include <algorithm>
+#include <cmath>
 
 void ParticleSystem::update(float dt, glm::vec3 wind_value)
 {
@@ -10,43 +11,58 @@ void ParticleSystem::update(float dt, glm::vec3 wind_value)
   }
 }
 
-void ParticleSystem::render(vk::CommandBuffer cmd_buf, glm::vec3 cam_pos)
+namespace
 {
-  std::ranges::sort(
-    emitters,
-    [cam_pos](const Emitter& a, const Emitter& b) {
-      return glm::distance(a.position, cam_pos) > glm::distance(b.position, cam_pos);
-  });
 
-  void* mapping = particleBuffer.map();
-  glm::vec4* particleData = static_cast<glm::vec4*>(mapping);
+// The vertex shader wobbles particles around by up to this distance
+constexpr float PARTICLE_WOBBLE_RADIUS = 0.6f;
+// and pulsates their size by up to this factor
+constexpr float PARTICLE_MAX_PULSATION = 1.5f;
 
-  size_t totalParticles = 0;
-  for (auto& emitter : emitters)
-  {
-    if (emitter.particles.empty())
-      continue;
+bool is_visible(const glm::vec3& position, float size, const ParticleView& view)
+{
+  const glm::vec4 clip = view.viewProj * glm::vec4(position, 1.0f);
+  if (clip.w <= -PARTICLE_WOBBLE_RADIUS)
+    return false;
+
+  // Points are clipped by their center only, the margin accounts for the sprite and the wobble
+  const float w = std::max(clip.w, 1e-3f);
+  const glm::vec2 margin =
+    glm::vec2(size * PARTICLE_MAX_PULSATION) / view.viewportSize + PARTICLE_WOBBLE_RADIUS * view.focalLength / w;
+  return std::abs(clip.x) <= w * (1.0f + margin.x) && std::abs(clip.y) <= w * (1.0f + margin.y);
+}
 
-    std::ranges::sort(
-      emitter.particles,
-      [cam_pos](const Particle& a, const Particle& b) {
-        return glm::distance(a.position, cam_pos) > glm::distance(b.position, cam_pos);
-      });
+} // namespace
 
+void ParticleSystem::render(vk::CommandBuffer cmd_buf, const ParticleView& view)
+{
+  // Only particles inside the view are sorted and uploaded
+  visibleParticles.clear();
+  for (const auto& emitter : emitters)
+  {
     for (const auto& particle : emitter.particles)
     {
-      if (totalParticles >= MAX_PARTICLES)
-        break;
-      particleData[totalParticles] = glm::vec4(particle.position, particle.size);
-      ++totalParticles;
+      if (!is_visible(particle.position, particle.size, view))
+        continue;
+      const glm::vec3 toCamera = particle.position - view.cameraPosition;
+      visibleParticles.emplace_back(glm::dot(toCamera, toCamera), glm::vec4(particle.position, particle.size));
     }
   }
 
-  particleBuffer.unmap();
+  std::ranges::sort(
+    visibleParticles,
+    [](const auto& a, const auto& b) { return a.first > b.first; });
 
+  const std::size_t totalParticles = std::min(visibleParticles.size(), MAX_PARTICLES);
   if (totalParticles == 0)
     return;
 
+  void* mapping = particleBuffer.map();
+  glm::vec4* particleData = static_cast<glm::vec4*>(mapping);
+  for (std::size_t i = 0; i < totalParticles; ++i)
+    particleData[i] = visibleParticles[i].second;
+  particleBuffer.unmap();
+
   cmd_buf.bindVertexBuffers(0, {particleBuffer.get()}, {0});
   cmd_buf.draw(static_cast<uint32_t>(totalParticles), 1, 0, 0);
 }
@@ -2,11 +2,21 @@
 
 #include "Emitter.hpp"
 
+#include <utility>
 #include <vector>
 #include <etna/Buffer.hpp>
 #include <vulkan/vulkan.hpp>
 #include <glm/glm.hpp>
 
+struct ParticleView
+{
+  glm::mat4 viewProj;
+  glm::vec3 cameraPosition;
+  glm::vec2 viewportSize;
+  // Vertical focal length of the projection
+  float focalLength;
+};
+
 class ParticleSystem
 {
 public:
@@ -14,12 +24,14 @@ public:
   ~ParticleSystem() = default;
 
   void update(float dt, glm::vec3 wind_value);
-  void render(vk::CommandBuffer cmd_buf, glm::vec3 cam_pos);
+  // Uploads the particles inside the view, sorted back to front, and draws them
+  void render(vk::CommandBuffer cmd_buf, const ParticleView& view);
   void addEmitter(const Emitter& emitter);
   void removeEmitter(size_t index);
 
   const std::vector<Emitter>& getEmitters() const { return emitters; }
   const etna::Buffer& getParticleBuffer()   const { return particleBuffer; }
+  std::size_t getVisibleParticleCount()     const { return visibleParticles.size(); }
 
   glm::vec3 wind = {0.0f, 0.0f, 0.0f};
 
@@ -29,4 +41,8 @@ public:
   uint32_t max_particlesPerEmitter = 2500;
 
   static constexpr std::size_t MAX_PARTICLES = 500'000;
-};
\ No newline at end of file
+
+private:
+  // Squared distance to the camera and position with size, reused between frames
+  std::vector<std::pair<float, glm::vec4>> visibleParticles;
+};
@@ -10,11 +10,10 @@
 #include <vector>
 
 WorldRenderer::WorldRenderer()
-  : sceneMgr{std::make_unique<SceneManager>()}
+  : sceneMgr{std::make_unique<SceneManager>()},
+    terrainRenderer{std::make_unique<TerrainRenderer>()}
 {
   gui = std::make_unique<WorldRendererGui>(*this);
-  groupCountX = (terrainTextureSizeWidth + computeWorkgroupSize - 1) / computeWorkgroupSize;
-  groupCountY = (terrainTextureSizeHeight + computeWorkgroupSize - 1) / computeWorkgroupSize;
 }
 
 void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
@@ -50,17 +49,6 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
   });
   uniformMapping = uniformParamsBuffer.map();
 
-  perlinValuesBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(PerlinParams),
-    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
-    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-    .name = "perlin_values",
-  });
-  perlinValuesMapping = perlinValuesBuffer.map();
-
-  std::memcpy(perlinValuesMapping, &perlinParams, sizeof(PerlinParams));
-
   maxInstances = 1;
   instanceMatricesBuffer = ctx.createBuffer(etna::Buffer::CreateInfo
   {
@@ -72,25 +60,7 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
   });
   persistentMapping = instanceMatricesBuffer.map();
 
-  perlinTerrainImage = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{terrainTextureSizeWidth, terrainTextureSizeHeight, 1},
-    .name = "perlin_noise",
-    .format = vk::Format::eR32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage});
-
-  normalMapTerrainImage = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{terrainTextureSizeWidth, terrainTextureSizeHeight, 1},
-    .name = "normal_map_terrain",
-    .format = vk::Format::eR32G32B32A32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage});
-
-  auto cmdManager = ctx.createOneShotCmdMgr();
-  auto cmdBuf = cmdManager->start();
-  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
-  createTerrainMap(cmdBuf);
-  ETNA_CHECK_VK_RESULT(cmdBuf.end());
-
-  cmdManager->submitAndWait(cmdBuf);
+  terrainRenderer->allocateResources(constants, uniformParamsBuffer, defaultSampler);
 }
 
 void WorldRenderer::loadScene(std::filesystem::path path)
@@ -124,15 +94,8 @@ void WorldRenderer::loadShaders()
     "static_mesh_material",
     {PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
      PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
-  etna::create_program("perlin_terrain", {PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "terrain_perlin.comp.spv"});
-  etna::create_program("normal_map_generation", {PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "terrain_normal.comp.spv"});
-  etna::create_program(
-    "terrain_render",
-    {PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "terrain.vert.spv",
-     PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "terrain.tesc.spv",
-     PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "terrain.tese.spv",
-     PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "terrain.frag.spv"});
   etna::create_program("particle_render", {PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "particle.frag.spv", PARTICLES_TERRAIN_RENDERER_SHADERS_ROOT "particle.vert.spv"});
+  terrainRenderer->loadShaders();
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
@@ -179,25 +142,6 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
           .depthAttachmentFormat = vk::Format::eD32Sfloat,
         },
     });
-  perlinPipeline = pipelineManager.createComputePipeline("perlin_terrain", {});
-  normalPipeline = pipelineManager.createComputePipeline("normal_map_generation", {});
-  terrainPipeline = pipelineManager.createGraphicsPipeline(
-    "terrain_render",
-    etna::GraphicsPipeline::CreateInfo{
-      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {swapchain_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
   particlePipeline = pipelineManager.createGraphicsPipeline(
     "particle_render",
     etna::GraphicsPipeline::CreateInfo{
@@ -240,6 +184,7 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
           .depthAttachmentFormat = vk::Format::eD32Sfloat,
         },
     });
+  terrainRenderer->setupPipelines(swapchain_format);
 }
 
 bool WorldRenderer::isVisibleBoundingBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& mvp) const
@@ -309,8 +254,10 @@ void WorldRenderer::update(const FramePacket& packet)
   // calc camera matrix
   {
     const float aspect = float(resolution.x) / float(resolution.y);
-    worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+    const glm::mat4 proj = packet.mainCam.projTm(aspect);
+    worldViewProj = proj * packet.mainCam.viewTm();
     camView = packet.mainCam.position;
+    focalLength = std::abs(proj[1][1]);
   }
 
   std::memcpy(uniformMapping, &uniformParams, sizeof(UniformParams));
@@ -328,7 +275,8 @@ void WorldRenderer::update(const FramePacket& packet)
     nextMilestone += 5000;
   }
 
-  std::memcpy(perlinValuesMapping, &perlinParams, sizeof(PerlinParams));
+  terrainRenderer->update(perlinParams);
+  terrainRenderer->selectNodes(camView, worldViewProj);
 
   WorldRendererConstants worldConstants{
     .viewProj = worldViewProj,
@@ -509,6 +457,11 @@ void WorldRenderer::renderWorld(
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
+  // Terrain edits are regenerated a few tiles per frame in the background
+  terrainRenderer->updateTerrainMaps(cmd_buf);
+  if (enableTerrainRendering)
+    terrainRenderer->cullPatches(cmd_buf);
+
   {
     etna::RenderTargetState renderTargets(
       cmd_buf,
@@ -525,8 +478,7 @@ void WorldRenderer::renderWorld(
     if (enableTerrainRendering)
     {
       ETNA_PROFILE_GPU(cmd_buf, renderTerrain);
-      cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, terrainPipeline.getVkPipeline());
-      renderTerrain(cmd_buf);
+      terrainRenderer->render(cmd_buf);
     }
   }
 
@@ -551,148 +503,23 @@ void WorldRenderer::renderWorld(
         vk::PipelineBindPoint::eGraphics, particlePipeline.getVkPipelineLayout(), 0,
         {descSet.getVkSet()}, {});
     }
-    particleSystem->render(cmd_buf, camView);
+    particleSystem->render(
+      cmd_buf,
+      ParticleView{
+        .viewProj = worldViewProj,
+        .cameraPosition = camView,
+        .viewportSize = glm::vec2(resolution),
+        .focalLength = focalLength,
+      });
   }
 
   if (drawDebugTerrainQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, perlinTerrainImage, defaultSampler);
-}
-
-void WorldRenderer::renderTerrain(vk::CommandBuffer cmd_buf)
-{
-  auto info = etna::get_shader_program("terrain_render");
-  auto perlinBind = perlinTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
-  auto normalBind = normalMapTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
-
-  auto descSet = etna::create_descriptor_set(
-    info.getDescriptorLayoutId(0),
-    cmd_buf,
-    {
-      etna::Binding{0, perlinBind},
-      etna::Binding{1, normalBind},
-      etna::Binding{2, constants.genBinding()},
-      etna::Binding{3, uniformParamsBuffer.genBinding()},
-    });
-  auto vkSet = descSet.getVkSet();
-  auto layout = terrainPipeline.getVkPipelineLayout();
-
-  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &vkSet, 0, nullptr);
-
-  cmd_buf.draw(4, (terrainTextureSizeWidth * terrainTextureSizeHeight) / (computeWorkgroupSize * computeWorkgroupSize * 16), 0, 0);
+    quadRenderer->render(cmd_buf, target_image, target_image_view, terrainRenderer->getPerlinTerrainImage(), defaultSampler);
 }
 
 void WorldRenderer::regenerateTerrain()
 {
-  auto& ctx = etna::get_context();
-  auto cmdManager = ctx.createOneShotCmdMgr();
-  auto cmdBuf = cmdManager->start();
-  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
-  createTerrainMap(cmdBuf);
-  ETNA_CHECK_VK_RESULT(cmdBuf.end());
-  cmdManager->submitAndWait(cmdBuf);
-}
-
-void WorldRenderer::createTerrainMap(vk::CommandBuffer cmd_buf)
-{
-  etna::set_state(
-    cmd_buf,
-    perlinTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eComputeShader,
-    vk::AccessFlagBits2::eShaderWrite,
-    vk::ImageLayout::eGeneral,
-    vk::ImageAspectFlagBits::eColor);
-
-  etna::flush_barriers(cmd_buf);
-
-  {
-    auto perlinInfo = etna::get_shader_program("perlin_terrain");
-
-    auto binding = perlinTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eGeneral, {});
-
-    auto set = etna::create_descriptor_set(
-      perlinInfo.getDescriptorLayoutId(0),
-      cmd_buf,
-      {
-        etna::Binding{0, binding},
-        etna::Binding{1, perlinValuesBuffer.genBinding()},
-      });
-
-    vk::DescriptorSet vkSet = set.getVkSet();
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, perlinPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eCompute,
-      perlinPipeline.getVkPipelineLayout(),
-      0,
-      1,
-      &vkSet,
-      0,
-      nullptr);
-
-    cmd_buf.dispatch(terrainTextureSizeWidth / computeWorkgroupSize, terrainTextureSizeHeight / computeWorkgroupSize, 1);
-  }
-
-  etna::set_state(
-    cmd_buf,
-    perlinTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eComputeShader,
-    vk::AccessFlagBits2::eShaderRead,
-    vk::ImageLayout::eGeneral,
-    vk::ImageAspectFlagBits::eColor);
-
-  etna::set_state(
-    cmd_buf,
-    normalMapTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eComputeShader,
-    vk::AccessFlagBits2::eShaderWrite,
-    vk::ImageLayout::eGeneral,
-    vk::ImageAspectFlagBits::eColor);
-  etna::flush_barriers(cmd_buf);
-
-  {
-    auto normalInfo = etna::get_shader_program("normal_map_generation");
-    auto binding0 = perlinTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eGeneral, {});
-    auto binding1 = normalMapTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eGeneral, {});
-
-    auto set = etna::create_descriptor_set(
-      normalInfo.getDescriptorLayoutId(0),
-      cmd_buf,
-      {
-        etna::Binding{0, binding0},
-        etna::Binding{1, binding1},
-      });
-
-    vk::DescriptorSet vkSet = set.getVkSet();
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, normalPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eCompute,
-      normalPipeline.getVkPipelineLayout(),
-      0,
-      1,
-      &vkSet,
-      0,
-      nullptr);
-
-    cmd_buf.dispatch(groupCountX, groupCountY, 1);
-  }
-
-  etna::set_state(
-    cmd_buf,
-    perlinTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eTessellationEvaluationShader,
-    vk::AccessFlagBits2::eShaderSampledRead,
-    vk::ImageLayout::eReadOnlyOptimal,
-    vk::ImageAspectFlagBits::eColor);
-
-  etna::set_state(
-    cmd_buf,
-    normalMapTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eTessellationEvaluationShader,
-    vk::AccessFlagBits2::eShaderSampledRead,
-    vk::ImageLayout::eReadOnlyOptimal,
-    vk::ImageAspectFlagBits::eColor);
-  etna::flush_barriers(cmd_buf);
+  terrainRenderer->regenerateTerrain();
 }
 
 float WorldRenderer::getCameraSpeed() const
@@ -12,6 +12,7 @@
 #include "scene/SceneManager.hpp"
 #include "wsi/Keyboard.hpp"
 #include "render_utils/QuadRenderer.hpp"
+#include "terrain/TerrainRenderer.hpp"
 
 #include "FramePacket.hpp"
 
@@ -55,9 +56,6 @@ public:
 private:
   void renderScene(
     vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
-  void createTerrainMap(vk::CommandBuffer cmd_buf);
-  void renderTerrain(vk::CommandBuffer cmd_buf);
-  void reallocateTerrainResources();
   void regenerateTerrain();
 
   bool isVisibleBoundingBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& mvp) const;
@@ -66,16 +64,12 @@ private:
   std::unique_ptr<SceneManager> sceneMgr;
 
   etna::Image mainViewDepth;
-  etna::Image perlinTerrainImage;
-  etna::Image normalMapTerrainImage;
   etna::Buffer instanceMatricesBuffer;
   etna::Buffer constants;
   etna::Buffer uniformParamsBuffer;
-  etna::Buffer perlinValuesBuffer;
 
   void* persistentMapping = nullptr;
   void* uniformMapping = nullptr;
-  void* perlinValuesMapping = nullptr;
   uint32_t maxInstances = 0;
   uint32_t max_particles = 10000;
 
@@ -84,17 +78,17 @@ private:
 
   glm::mat4x4 worldViewProj;
   glm::vec3 camView;
+  float focalLength = 1.0f;
   float nearPlane;
   float farPlane;
 
   etna::GraphicsPipeline staticMeshPipeline{};
-  etna::ComputePipeline perlinPipeline{};
-  etna::ComputePipeline normalPipeline{};
-  etna::GraphicsPipeline terrainPipeline{};
   etna::GraphicsPipeline particlePipeline{};
 
   std::unique_ptr<QuadRenderer> quadRenderer;
 
+  std::unique_ptr<TerrainRenderer> terrainRenderer;
+
   std::unique_ptr<ParticleSystem> particleSystem;
 
   std::unique_ptr<WorldRendererGui> gui;
@@ -121,6 +115,7 @@ private:
     .amplitude = 0.5f,
     .frequencyMultiplier = 2.0f,
     .scale = 8.0f,
+    .time = 0.0f,
   };
 
   etna::Sampler defaultSampler;
@@ -142,13 +137,6 @@ private:
 
   float previousTime = 0.0f;
 
-  std::uint32_t terrainTextureSizeWidth  = 4096;
-  std::uint32_t terrainTextureSizeHeight = 4096;
-  std::uint32_t computeWorkgroupSize = 32;
-  std::uint32_t patchSubdivision = 8;
-  std::uint32_t groupCountX;
-  std::uint32_t groupCountY;
-
   uint32_t renderedInstances = 0;
 
   uint32_t totalParticles = 0;
@@ -1,9 +0,0 @@
-#version 450
-
-layout(location = 0) out uint InstanceIndex;
-
-void main()
-{
-    InstanceIndex = gl_InstanceIndex;
-    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
-}
\ No newline at end of file
@@ -1,11 +1,12 @@
 #pragma once
 
 #include "shaders/UniformParams.h"
-#include <vector>
+#include <cstdint>
 #include <glm/glm.hpp>
-#include <etna/Buffer.hpp>
-#include <etna/ComputePipeline.hpp>
 
+// CPU-side description of an emitter. Particles of all emitters live in
+// a single pool owned by ParticleSystem, an emitter only references its
+// slot in the GPU emitter array.
 class Emitter
 {
 public:
@@ -16,55 +17,20 @@ public:
   float spawnFrequency;
   float particleLifetime;
   float size;
-  float timeSinceLastSpawn = 0.0f;
+  glm::vec4 color = {1.0f, 1.0f, 1.0f, 1.0f};
+  // Random velocity added to every particle, as a fraction of initialVelocity length
+  float velocitySpread = 0.0f;
 
-  // [[deprecated("Use GPU-based particle system instead")]]
-  std::vector<ParticleGPU> particles;
+  static constexpr std::uint32_t INVALID_SLOT = ~0u;
+  std::uint32_t gpuSlot = INVALID_SLOT;
 
-  etna::Buffer particleSSBO;
-  etna::Buffer particleUBO;
-  etna::Buffer particleCountBuffer;
-  etna::Buffer spawnUBO;
-  etna::Buffer emitterSSBO;
-  etna::Buffer indirectDrawBuffer;
-
-  void* particleSSBOMapping = nullptr;
-  void* particleCountMapping = nullptr;
-  void* emitterSSBOMapping = nullptr;
-
-  std::uint32_t currentParticleCount = 0;
-  std::uint32_t maxParticlesPerEmitter = 500'000;
-
-  void update(float dt, glm::vec3 wind,
-              const etna::ComputePipeline& spawn_pipeline,
-              const etna::ComputePipeline& calculate_pipeline,
-              const etna::ComputePipeline& integrate_pipeline);
   void clearParticles();
-  void allocateGPUResources();
-
-  struct ParticleUBO {
-    float deltaT;
-    uint32_t particleCount;
-    glm::vec3 gravity;
-    glm::vec3 wind;
-    float drag;
-  };
-  ParticleUBO particleUbo;
-
-  struct SpawnUBO {
-    float deltaTime;
-    uint32_t emitterCount;
-  };
-  SpawnUBO spawnData;
-
-  struct EmitterGPU {
-    glm::vec3 position;
-    float timeSinceLastSpawn;
-    glm::vec3 initialVelocity;
-    float spawnFrequency;
-    float particleLifetime;
-    float size;
-    uint32_t maxParticlesPerEmitter;
-    uint32_t currentParticles;
-  };
-};
\ No newline at end of file
+  // Spawns count particles at once on the next simulated frame, on top of the regular rate
+  void burst(std::uint32_t count);
+  EmitterGPU toGPU();
+
+private:
+  bool justAdded = true;
+  bool clearRequested = false;
+  std::uint32_t pendingBurst = 0;
+};
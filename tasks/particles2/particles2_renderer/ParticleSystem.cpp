@@ -1,142 +1,714 @@
 #include "ParticleSystem.hpp"
 #include "etna/Etna.hpp"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/Profiling.hpp>
-#include <etna/RenderTargetStates.hpp>
 #include <glm/ext.hpp>
-#include <imgui.h>
+#include <numeric>
+#include <spdlog/spdlog.h>
+#include <utility>
 #include <vector>
 
-void ParticleSystem::allocateResources(){/*empty*/}
+#include "render_utils/Barriers.hpp"
+
+namespace
+{
+
+void shader_write_barrier(
+  vk::CommandBuffer cmd_buf, vk::PipelineStageFlags2 dst_stage, vk::AccessFlags2 dst_access)
+{
+  memory_barrier(
+    cmd_buf, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderWrite, dst_stage, dst_access);
+}
+
+} // namespace
+
+static_assert(sizeof(ParticleGPU) == 24);
+static_assert(sizeof(ParticleRenderGPU) == 12);
+// Emitter slots are packed into 16 bits of ParticleGPU::velocityZEmitter
+static_assert(ParticleSystem::MAX_EMITTERS <= (1u << 16));
+// Pool indices share the draw payload with the alpha scale
+static_assert(ParticleSystem::MAX_PARTICLES <= (1u << PARTICLE_INDEX_BITS));
+
+void ParticleSystem::allocateResources()
+{
+  auto& ctx = etna::get_context();
+
+  particleBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_PARTICLES * sizeof(ParticleGPU),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_pool",
+  });
+
+  renderParticleBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_PARTICLES * sizeof(ParticleRenderGPU),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_render_stream",
+  });
+
+  deadListBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_PARTICLES * sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_dead_list",
+  });
+
+  for (std::size_t i = 0; i < aliveListBuffers.size(); ++i)
+  {
+    aliveListBuffers[i] = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = MAX_PARTICLES * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = i == 0 ? "particle_alive_list_0" : "particle_alive_list_1",
+    });
+  }
+
+  counterBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(ParticleCounters),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+      vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_counters",
+  });
+
+  statsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(ParticleCounters),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "particle_stats",
+  });
+  statsMapping = statsBuffer.map();
+  ParticleCounters initialStats{};
+  initialStats.deadCount = MAX_PARTICLES;
+  std::memcpy(statsMapping, &initialStats, sizeof(ParticleCounters));
+
+  constexpr std::array<const char*, FRAME_RING> emitterBufferNames{
+    "particle_emitters_0", "particle_emitters_1", "particle_emitters_2"};
+  for (std::size_t i = 0; i < emitterBuffers.size(); ++i)
+  {
+    emitterBuffers[i] = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = MAX_EMITTERS * sizeof(EmitterGPU),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      .name = emitterBufferNames[i],
+    });
+    emitterMappings[i] = emitterBuffers[i].map();
+  }
+
+  emitterStateBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_EMITTERS * sizeof(float),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_emitter_state",
+  });
+
+  // x - sort key, y - draw payload of a visible particle
+  sortBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_PARTICLES * sizeof(glm::uvec2),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_sort_keys",
+  });
+
+  gridCellCountBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = PARTICLE_GRID_HASH_SIZE * sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_grid_cell_counts",
+  });
+
+  gridCellStartBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = PARTICLE_GRID_HASH_SIZE * sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_grid_cell_starts",
+  });
+
+  gridBlockSumBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = PARTICLE_GRID_HASH_SIZE / PARTICLE_GRID_SCAN_BLOCK * sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_grid_block_sums",
+  });
+
+  // x - hashed cell, y - rank inside the cell, indexed like the alive list
+  gridParticleCellBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_PARTICLES * sizeof(glm::uvec2),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_grid_particle_cells",
+  });
+
+  gridPositionBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_PARTICLES * sizeof(glm::vec4),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_grid_positions",
+  });
+
+  emitterParams.assign(MAX_EMITTERS, EmitterGPU{});
+  resetPending = true;
+}
 
 void ParticleSystem::setupPipelines()
 {
   auto& ctx = etna::get_context();
   auto& pipelineManager = ctx.getPipelineManager();
+  particleResetPipeline     = pipelineManager.createComputePipeline("particle_reset",     {});
+  particleSpawnPipeline     = pipelineManager.createComputePipeline("particle_spawn",     {});
+  particleArgsPipeline      = pipelineManager.createComputePipeline("particle_args",      {});
+  particleGridCountPipeline   = pipelineManager.createComputePipeline("particle_grid_count",   {});
+  particleGridScanPipeline    = pipelineManager.createComputePipeline("particle_grid_scan",    {});
+  particleGridScatterPipeline = pipelineManager.createComputePipeline("particle_grid_scatter", {});
   particleCalculatePipeline = pipelineManager.createComputePipeline("particle_calculate", {});
   particleIntegratePipeline = pipelineManager.createComputePipeline("particle_integrate", {});
-  particleSpawnPipeline     = pipelineManager.createComputePipeline("particle_spawn",     {});
-  particleSortPipeline      = pipelineManager.createComputePipeline("particle_sort",      {});
+  particleCullPipeline      = pipelineManager.createComputePipeline("particle_cull",      {});
+
+  sorter = std::make_unique<GpuSort>();
 }
 
-void ParticleSystem::update(float dt, const glm::vec3 wind_value)
+void ParticleSystem::update(float dt, const glm::vec3 wind_value, const glm::vec3 camera_position)
 {
-  for (auto& emitter : emitters)
+  deltaTime = dt;
+  wind = wind_value;
+  cameraPosition = camera_position;
+
+  for (auto& retired : retiredEmitterSlots)
   {
-    emitter.update(dt, wind_value, particleSpawnPipeline, particleCalculatePipeline, particleIntegratePipeline);
+    if (--retired.framesLeft == 0)
+    {
+      emitterParams[retired.slot] = EmitterGPU{};
+      freeEmitterSlots.push_back(retired.slot);
+    }
   }
+  std::erase_if(retiredEmitterSlots, [](const RetiredSlot& retired) { return retired.framesLeft == 0; });
+
+  uploadEmitters();
+
+  // Statistics are a few frames late, which is fine for sizing the sort and for the GUI
+  ParticleCounters stats;
+  std::memcpy(&stats, statsMapping, sizeof(ParticleCounters));
+  aliveParticleCount = std::min(stats.aliveCountAfterSimulation, MAX_PARTICLES);
+  visibleParticleCount = std::min(stats.visibleCount, MAX_PARTICLES);
+
+  // The count is a few frames old, leave room for everything spawned since then.
+  // Particles that come into view faster than that are missing for a few frames.
+  const std::uint32_t spawnedInFlight = std::accumulate(recentSpawnCounts.begin(), recentSpawnCounts.end(), 0u);
+  const std::uint32_t expectedCount = std::min(visibleParticleCount + spawnedInFlight, MAX_PARTICLES);
+  sortCapacity = expectedCount == 0 ? 0 : std::min(std::bit_ceil(expectedCount), MAX_PARTICLES);
 }
 
-void ParticleSystem::sortAllEmitters(vk::CommandBuffer cmd_buf, glm::vec3 cam_pos)
+void ParticleSystem::uploadEmitters()
 {
+  // Upper estimate of this frame's spawns, rounded up per emitter like the GPU accumulators
+  float expectedSpawns = 0.0f;
   for (auto& emitter : emitters)
   {
-    if (emitter.currentParticleCount == 0)
-      continue;
-
-    sortEmitterParticles(cmd_buf, emitter, cam_pos);
+    const EmitterGPU params = emitter.toGPU();
+    emitterParams[emitter.gpuSlot] = params;
+    expectedSpawns += std::ceil(std::max(params.spawnFrequency, 0.0f) * deltaTime) + float(params.burstCount);
   }
+  recentSpawnCounts[frameIndex % recentSpawnCounts.size()] =
+    static_cast<std::uint32_t>(std::min(expectedSpawns, float(MAX_PARTICLES)));
+
+  for (const auto& retired : retiredEmitterSlots)
+    emitterParams[retired.slot].flags = EMITTER_FLAG_KILL;
+
+  // One-shot flags are only in this frame's copy, frames still in flight keep reading theirs
+  emitterSection = (emitterSection + 1) % FRAME_RING;
+  std::memcpy(emitterMappings[emitterSection], emitterParams.data(), emitterSlotCount * sizeof(EmitterGPU));
 }
 
-void ParticleSystem::render(vk::CommandBuffer cmd_buf)
+void ParticleSystem::simulate(vk::CommandBuffer cmd_buf)
 {
-  for (auto& emitter : emitters)
+  ETNA_PROFILE_GPU(cmd_buf, simulateParticles);
+
+  if (resetPending)
+  {
+    auto resetInfo = etna::get_shader_program("particle_reset");
+    auto descSet = etna::create_descriptor_set(
+      resetInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, particleBuffer.genBinding()},
+        etna::Binding{1, deadListBuffer.genBinding()},
+        etna::Binding{2, counterBuffer.genBinding()},
+      });
+
+    const std::uint32_t maxParticles = MAX_PARTICLES;
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleResetPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, particleResetPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      particleResetPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(maxParticles),
+      &maxParticles);
+    cmd_buf.dispatch((MAX_PARTICLES + PARTICLE_WORKGROUP_SIZE - 1) / PARTICLE_WORKGROUP_SIZE, 1, 1);
+    compute_barrier(cmd_buf);
+
+    currentAliveList = 0;
+    resetPending = false;
+  }
+
+  const etna::Buffer& aliveList = aliveListBuffers[currentAliveList];
+  const etna::Buffer& aliveListNext = aliveListBuffers[1 - currentAliveList];
+
+  // The render stream is rewritten below, the previous frame must be done drawing it.
+  // Only compute waits here, the graphics work of this frame does not depend on the simulation.
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eComputeShader,
+    {},
+    vk::PipelineStageFlagBits2::eComputeShader,
+    {});
+
+  // Spawn particles of all emitters, one workgroup per emitter
+  if (emitterSlotCount > 0)
+  {
+    struct PushConstants
+    {
+      float deltaTime;
+      std::uint32_t maxParticles;
+      std::uint32_t frameIndex;
+    } pushConstants{deltaTime, MAX_PARTICLES, frameIndex};
+
+    auto spawnInfo = etna::get_shader_program("particle_spawn");
+    auto descSet = etna::create_descriptor_set(
+      spawnInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, particleBuffer.genBinding()},
+        etna::Binding{1, emitterBuffers[emitterSection].genBinding()},
+        etna::Binding{2, emitterStateBuffer.genBinding()},
+        etna::Binding{3, deadListBuffer.genBinding()},
+        etna::Binding{4, counterBuffer.genBinding()},
+        etna::Binding{5, aliveList.genBinding()},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleSpawnPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, particleSpawnPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      particleSpawnPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(PushConstants),
+      &pushConstants);
+    cmd_buf.dispatch(emitterSlotCount, 1, 1);
+    compute_barrier(cmd_buf);
+  }
+
+  // Size the simulation over the alive list on the GPU
+  recordArgsPass(cmd_buf, PARTICLE_ARGS_PASS_SIMULATE);
+
+  const vk::DeviceSize simulateArgsOffset = offsetof(ParticleCounters, simulateGroupsX);
+
+  if (interaction.mode == ParticleInteraction::SpatialHash)
+    buildSpatialGrid(cmd_buf, aliveList);
+
+  // Calculate pass
+  {
+    struct PushConstants
+    {
+      glm::vec3 wind;
+      float deltaT;
+      std::uint32_t interactionMode;
+      float interactionStrength;
+      float interactionRadius;
+      std::uint32_t maxNeighbours;
+    } pushConstants{
+      wind,
+      deltaTime,
+      static_cast<std::uint32_t>(interaction.mode),
+      interaction.strength,
+      std::max(interaction.radius, 0.01f),
+      interaction.maxNeighbours,
+    };
+
+    auto calculateInfo = etna::get_shader_program("particle_calculate");
+    auto descSet = etna::create_descriptor_set(
+      calculateInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, particleBuffer.genBinding()},
+        etna::Binding{1, emitterBuffers[emitterSection].genBinding()},
+        etna::Binding{2, deadListBuffer.genBinding()},
+        etna::Binding{3, counterBuffer.genBinding()},
+        etna::Binding{4, aliveList.genBinding()},
+        etna::Binding{5, gridCellCountBuffer.genBinding()},
+        etna::Binding{6, gridCellStartBuffer.genBinding()},
+        etna::Binding{7, gridPositionBuffer.genBinding()},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleCalculatePipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, particleCalculatePipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      particleCalculatePipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(PushConstants),
+      &pushConstants);
+    cmd_buf.dispatchIndirect(counterBuffer.get(), simulateArgsOffset);
+    compute_barrier(cmd_buf);
+  }
+
+  // Integrate pass, also compacts survivors into the other alive list
   {
-    if (emitter.currentParticleCount == 0)
-      continue;
+    auto integrateInfo = etna::get_shader_program("particle_integrate");
+    auto descSet = etna::create_descriptor_set(
+      integrateInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, particleBuffer.genBinding()},
+        etna::Binding{1, counterBuffer.genBinding()},
+        etna::Binding{2, aliveList.genBinding()},
+        etna::Binding{3, aliveListNext.genBinding()},
+        etna::Binding{4, renderParticleBuffer.genBinding()},
+        etna::Binding{5, emitterBuffers[emitterSection].genBinding()},
+      });
+
+    struct PushConstants
+    {
+      glm::vec3 cameraPosition;
+      float deltaT;
+    } pushConstants{cameraPosition, deltaTime};
 
-    cmd_buf.bindVertexBuffers(0, {emitter.particleSSBO.get()}, {0});
-    cmd_buf.drawIndirect(emitter.indirectDrawBuffer.get(), 0, 1, 0);
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleIntegratePipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, particleIntegratePipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      particleIntegratePipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(PushConstants),
+      &pushConstants);
+    cmd_buf.dispatchIndirect(counterBuffer.get(), simulateArgsOffset);
+    compute_barrier(cmd_buf);
   }
+
+  // Statistics are copied before publishing, while the counters still hold
+  // the visible count of the previous frame next to the new alive count
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead);
+  cmd_buf.copyBuffer(
+    counterBuffer.get(),
+    statsBuffer.get(),
+    vk::BufferCopy{.srcOffset = 0, .dstOffset = 0, .size = sizeof(ParticleCounters)});
+  memory_barrier(
+    cmd_buf, vk::PipelineStageFlagBits2::eTransfer, {}, vk::PipelineStageFlagBits2::eComputeShader, {});
+
+  // Publish the compacted alive list, culling and drawing only see live particles
+  recordArgsPass(cmd_buf, PARTICLE_ARGS_PASS_PUBLISH);
+  currentAliveList = 1 - currentAliveList;
+  ++frameIndex;
 }
 
-void ParticleSystem::sortEmitterParticles(
-  vk::CommandBuffer cmd_buf,
-  Emitter& emitter,
-  glm::vec3 cam_pos)
+void ParticleSystem::recordArgsPass(vk::CommandBuffer cmd_buf, std::uint32_t args_pass)
 {
-  if (emitter.currentParticleCount <= 1)
-    return;
+  struct PushConstants
+  {
+    std::uint32_t argsPass;
+    std::uint32_t sortCapacity;
+  } pushConstants{args_pass, sortCapacity};
 
-  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleSortPipeline.getVkPipeline());
+  auto argsInfo = etna::get_shader_program("particle_args");
+  auto descSet = etna::create_descriptor_set(
+    argsInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, counterBuffer.genBinding()},
+    });
 
-  auto shaderInfo = etna::get_shader_program("particle_sort");
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleArgsPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, particleArgsPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+  cmd_buf.pushConstants(
+    particleArgsPipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    sizeof(PushConstants),
+    &pushConstants);
+  cmd_buf.dispatch(1, 1, 1);
 
-  std::uint32_t paddedCount = 1;
-  while (paddedCount < emitter.currentParticleCount)
-    paddedCount <<= 1;
+  // Indirect reads happen in the draw indirect stage, which every later draw waits for.
+  // The published arguments are only needed by the cull, its barrier is recorded there,
+  // so the scene rasterization recorded after the simulation can overlap with its tail.
+  vk::PipelineStageFlags2 dstStages = vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer;
+  vk::AccessFlags2 dstAccess =
+    vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eTransferRead;
+  if (args_pass != PARTICLE_ARGS_PASS_PUBLISH)
+  {
+    dstStages |= vk::PipelineStageFlagBits2::eDrawIndirect;
+    dstAccess |= vk::AccessFlagBits2::eIndirectCommandRead;
+  }
+  shader_write_barrier(cmd_buf, dstStages, dstAccess);
+}
 
-  struct PushConstants {
-    glm::vec3     cameraPosition;
-    std::uint32_t particleCount;
-    std::uint32_t stage;
-    std::uint32_t substage;
-  } pushConstants;
+void ParticleSystem::buildSpatialGrid(vk::CommandBuffer cmd_buf, const etna::Buffer& alive_list)
+{
+  ETNA_PROFILE_GPU(cmd_buf, buildParticleGrid);
 
-  pushConstants.cameraPosition = cam_pos;
-  pushConstants.particleCount = emitter.currentParticleCount;
+  const vk::DeviceSize simulateArgsOffset = offsetof(ParticleCounters, simulateGroupsX);
+  const float cellSize = std::max(interaction.radius, 0.01f);
 
-  for (std::uint32_t stage = 2; stage <= paddedCount; stage <<= 1) {
-    for (std::uint32_t substage = stage >> 1; substage > 0; substage >>= 1)
-    {
-      pushConstants.stage = substage;
-      pushConstants.substage = stage;
+  // Previous frame's calculate pass is done reading the counts before they are cleared
+  {
+    vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderRead,
+      .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    };
+    vk::DependencyInfo depInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    };
+    cmd_buf.pipelineBarrier2(&depInfo);
+  }
+  cmd_buf.fillBuffer(gridCellCountBuffer.get(), 0, VK_WHOLE_SIZE, 0);
+  {
+    vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite,
+    };
+    vk::DependencyInfo depInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    };
+    cmd_buf.pipelineBarrier2(&depInfo);
+  }
+
+  // Count particles per cell, every particle remembers its rank inside the cell
+  {
+    auto countInfo = etna::get_shader_program("particle_grid_count");
+    auto descSet = etna::create_descriptor_set(
+      countInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, particleBuffer.genBinding()},
+        etna::Binding{1, counterBuffer.genBinding()},
+        etna::Binding{2, alive_list.genBinding()},
+        etna::Binding{3, gridCellCountBuffer.genBinding()},
+        etna::Binding{4, gridParticleCellBuffer.genBinding()},
+      });
 
-      auto descSet = etna::create_descriptor_set(
-        shaderInfo.getDescriptorLayoutId(0),
-        cmd_buf,
-        {
-          etna::Binding{0, emitter.particleSSBO.genBinding()},
-        });
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleGridCountPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, particleGridCountPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      particleGridCountPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(cellSize),
+      &cellSize);
+    cmd_buf.dispatchIndirect(counterBuffer.get(), simulateArgsOffset);
+    compute_barrier(cmd_buf);
+  }
 
-      auto vkSet = descSet.getVkSet();
+  // Exclusive prefix sum of the counts gives the first slot of every cell
+  {
+    auto scanInfo = etna::get_shader_program("particle_grid_scan");
+    auto descSet = etna::create_descriptor_set(
+      scanInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, gridCellCountBuffer.genBinding()},
+        etna::Binding{1, gridCellStartBuffer.genBinding()},
+        etna::Binding{2, gridBlockSumBuffer.genBinding()},
+      });
 
-      cmd_buf.bindDescriptorSets(
-        vk::PipelineBindPoint::eCompute,
-        particleSortPipeline.getVkPipelineLayout(),
-        0,
-        1,
-        &vkSet,
-        0,
-        nullptr);
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleGridScanPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, particleGridScanPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
 
+    constexpr std::uint32_t blockCount = PARTICLE_GRID_HASH_SIZE / PARTICLE_GRID_SCAN_BLOCK;
+    const std::array<std::pair<std::uint32_t, std::uint32_t>, 3> scanPasses{{
+      {PARTICLE_GRID_SCAN_PASS_BLOCKS, blockCount},
+      {PARTICLE_GRID_SCAN_PASS_BLOCK_SUMS, 1},
+      {PARTICLE_GRID_SCAN_PASS_ADD, blockCount},
+    }};
+    for (const auto& [scanPass, groupCount] : scanPasses)
+    {
       cmd_buf.pushConstants(
-        particleSortPipeline.getVkPipelineLayout(),
+        particleGridScanPipeline.getVkPipelineLayout(),
         vk::ShaderStageFlagBits::eCompute,
         0,
-        sizeof(PushConstants),
-        &pushConstants);
-
-      std::uint32_t workgroups = (paddedCount + 255) / 256;
-      cmd_buf.dispatch(workgroups, 1, 1);
-      // etna::flush_barriers(cmd_buf);
-      vk::MemoryBarrier2 barrier{
-        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-        .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
-      };
-      vk::DependencyInfo depInfo{
-        .memoryBarrierCount = 1,
-        .pMemoryBarriers = &barrier,
-      };
-      cmd_buf.pipelineBarrier2(&depInfo);
+        sizeof(scanPass),
+        &scanPass);
+      cmd_buf.dispatch(groupCount, 1, 1);
+      compute_barrier(cmd_buf);
     }
   }
+
+  // Scatter positions into cell order
+  {
+    auto scatterInfo = etna::get_shader_program("particle_grid_scatter");
+    auto descSet = etna::create_descriptor_set(
+      scatterInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, particleBuffer.genBinding()},
+        etna::Binding{1, counterBuffer.genBinding()},
+        etna::Binding{2, alive_list.genBinding()},
+        etna::Binding{3, gridCellStartBuffer.genBinding()},
+        etna::Binding{4, gridParticleCellBuffer.genBinding()},
+        etna::Binding{5, gridPositionBuffer.genBinding()},
+        etna::Binding{6, emitterBuffers[emitterSection].genBinding()},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleGridScatterPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, particleGridScatterPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.dispatchIndirect(counterBuffer.get(), simulateArgsOffset);
+    compute_barrier(cmd_buf);
+  }
+}
+
+void ParticleSystem::cullAndSort(vk::CommandBuffer cmd_buf, const ParticleView& view, bool sort_back_to_front)
+{
+  // Arguments of the cull were published at the end of the simulation
+  shader_write_barrier(
+    cmd_buf, vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
+
+  // Entries past the visible ones keep the largest key and end up at the back
+  if (sortCapacity > 0)
+  {
+    memory_barrier(
+      cmd_buf,
+      vk::PipelineStageFlagBits2::eVertexShader,
+      {},
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite);
+    cmd_buf.fillBuffer(sortBuffer.get(), 0, sortCapacity * sizeof(glm::uvec2), 0xFFFFFFFFu);
+    memory_barrier(
+      cmd_buf,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderWrite);
+  }
+
+  // The cull runs even with nothing to sort, its statistics size the sort of the next frames
+  {
+    struct PushConstants
+    {
+      glm::mat4 viewProj;
+      glm::vec3 cameraPosition;
+      float pointScale;
+      glm::vec2 viewportSize;
+      float lodMinKeep;
+      std::uint32_t sortCapacity;
+      std::uint32_t enableLod;
+    } pushConstants{
+      view.viewProj,
+      view.cameraPosition,
+      view.pointScale,
+      view.viewportSize,
+      lod.minKeepProbability,
+      sortCapacity,
+      lod.enable ? 1u : 0u,
+    };
+
+    auto cullInfo = etna::get_shader_program("particle_cull");
+    auto descSet = etna::create_descriptor_set(
+      cullInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, renderParticleBuffer.genBinding()},
+        etna::Binding{1, counterBuffer.genBinding()},
+        etna::Binding{2, aliveListBuffers[currentAliveList].genBinding()},
+        etna::Binding{3, sortBuffer.genBinding()},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleCullPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, particleCullPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      particleCullPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(PushConstants),
+      &pushConstants);
+    // Sized over the alive list by the publish pass
+    cmd_buf.dispatchIndirect(counterBuffer.get(), offsetof(ParticleCounters, simulateGroupsX));
+    compute_barrier(cmd_buf);
+  }
+
+  recordArgsPass(cmd_buf, PARTICLE_ARGS_PASS_DRAW);
+
+  // Compute consumers of the unsorted list are covered by the barrier of the args pass
+  if (sortCapacity == 0 || !sort_back_to_front)
+    return;
+
+  // Only (key, index) pairs are sorted, particles themselves stay in their pool slots
+  sorter->sort(cmd_buf, sortBuffer, sortCapacity);
+
+  shader_write_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eDrawIndirect,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eIndirectCommandRead);
+}
+
+void ParticleSystem::render(vk::CommandBuffer cmd_buf)
+{
+  if (sortCapacity == 0)
+    return;
+
+  cmd_buf.drawIndirect(counterBuffer.get(), offsetof(ParticleCounters, vertexCount), 1, 0);
+}
+
+std::uint32_t ParticleSystem::acquireEmitterSlot()
+{
+  if (!freeEmitterSlots.empty())
+  {
+    const std::uint32_t slot = freeEmitterSlots.back();
+    freeEmitterSlots.pop_back();
+    return slot;
+  }
+
+  if (emitterSlotCount < MAX_EMITTERS)
+    return emitterSlotCount++;
+
+  return Emitter::INVALID_SLOT;
 }
 
 void ParticleSystem::addEmitter(Emitter&& emitter)
 {
+  emitter.gpuSlot = acquireEmitterSlot();
+  if (emitter.gpuSlot == Emitter::INVALID_SLOT)
+  {
+    spdlog::warn("Emitter limit of {} reached, emitter was not added", MAX_EMITTERS);
+    return;
+  }
+
   emitters.push_back(std::move(emitter));
-  emitters.back().allocateGPUResources();
 }
 
 void ParticleSystem::removeEmitter(size_t index)
 {
   if (index < emitters.size())
   {
+    retiredEmitterSlots.push_back(RetiredSlot{emitters[index].gpuSlot, SLOT_RETIRE_FRAMES});
     emitters.erase(emitters.begin() + index);
   }
 }
@@ -144,4 +716,11 @@ void ParticleSystem::removeEmitter(size_t index)
 void ParticleSystem::clearAllEmitters()
 {
   emitters.clear();
+  freeEmitterSlots.clear();
+  retiredEmitterSlots.clear();
+  emitterParams.assign(MAX_EMITTERS, EmitterGPU{});
+  emitterSlotCount = 0;
+
+  // The reset pass kills every particle, so slots can be reused right away
+  resetPending = true;
 }
@@ -1,72 +1,167 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <memory>
 #include <etna/Buffer.hpp>
 #include <etna/ComputePipeline.hpp>
 #include <vector>
 #include "Emitter.hpp"
+#include "render_utils/GpuSort.hpp"
+
+/**
+ * GPU particle system with a single particle pool shared by all emitters.
+ * Free slots are tracked in a GPU dead list, live ones in a pair of alive
+ * lists which are compacted during simulation. Every particle stores the slot
+ * of its emitter, so spawn, simulation and sorting are one dispatch each
+ * no matter how many emitters there are.
+ */
+enum class ParticleInteraction : std::uint32_t
+{
+  None        = PARTICLE_INTERACTION_NONE,
+  AllPairs    = PARTICLE_INTERACTION_ALL_PAIRS,
+  SpatialHash = PARTICLE_INTERACTION_SPATIAL_HASH,
+};
+
+struct ParticleLodSettings
+{
+  // Sub-pixel particles are stochastically thinned out, keeping the average coverage
+  bool enable = true;
+  // Below this probability the alpha of the kept particles is reduced instead
+  float minKeepProbability = 0.05f;
+};
+
+struct ParticleView
+{
+  glm::mat4 viewProj;
+  glm::vec3 cameraPosition;
+  glm::vec2 viewportSize;
+  // Half the viewport height times the vertical focal length, turns sizes into pixels
+  float pointScale;
+};
+
+struct ParticleInteractionSettings
+{
+  ParticleInteraction mode = ParticleInteraction::SpatialHash;
+  // Positive values attract particles to each other, negative ones push them apart
+  float strength = 0.5f;
+  // Also the grid cell size of the spatial hash
+  float radius = 0.5f;
+  // Caps the work per particle inside dense clusters
+  std::uint32_t maxNeighbours = 64;
+};
 
 class ParticleSystem
 {
 public:
+  static constexpr std::uint32_t MAX_PARTICLES = 1u << 21;
+  static constexpr std::uint32_t MAX_EMITTERS  = 1024;
+
   ParticleSystem() = default;
 
   void allocateResources();
   void setupPipelines();
-  void sortAllEmitters(vk::CommandBuffer cmd_buf, glm::vec3 cam_pos);
-  void render(vk::CommandBuffer cmd_buf);
 
-  void update(float dt, const glm::vec3 wind_value);
+  // CPU side of the frame: uploads emitter parameters and picks up GPU statistics.
+  // Render positions are stored relative to camera_position.
+  void update(float dt, glm::vec3 wind_value, glm::vec3 camera_position);
+  // Records spawn and simulation of all emitters
+  void simulate(vk::CommandBuffer cmd_buf);
+  // Keeps the visible particles and sorts them back to front for render.
+  // Without the sort the visible particles are left in append order for compute passes.
+  void cullAndSort(vk::CommandBuffer cmd_buf, const ParticleView& view, bool sort_back_to_front = true);
+  void render(vk::CommandBuffer cmd_buf);
 
   void addEmitter(Emitter&& emitter);
-  // void reallocateEmitterBuffer(std::size_t index);
-  void updateMaxParticles(std::uint32_t new_max);
   void removeEmitter(std::size_t index);
   void clearAllEmitters();
 
+  const std::vector<Emitter>& getEmitters() const { return emitters; }
+  std::uint32_t getAliveParticleCount() const { return aliveParticleCount; }
+  std::uint32_t getVisibleParticleCount() const { return visibleParticleCount; }
+
+  const etna::Buffer& getRenderParticleBuffer() const { return renderParticleBuffer; }
+  const etna::Buffer& getSortBuffer() const { return sortBuffer; }
+  const etna::Buffer& getCounterBuffer() const { return counterBuffer; }
+  // Upper bound of the visible particles in the sort buffer this frame
+  std::uint32_t getSortCapacity() const { return sortCapacity; }
+
   std::vector<Emitter> emitters;
-  const std::vector<Emitter>& getEmitters() const {return emitters;}
+  ParticleInteractionSettings interaction;
+  ParticleLodSettings lod;
 
+private:
+  std::uint32_t acquireEmitterSlot();
+  void uploadEmitters();
+  void recordArgsPass(vk::CommandBuffer cmd_buf, std::uint32_t args_pass);
+  void buildSpatialGrid(vk::CommandBuffer cmd_buf, const etna::Buffer& alive_list);
+
+private:
+  etna::ComputePipeline particleResetPipeline{};
+  etna::ComputePipeline particleSpawnPipeline{};
+  etna::ComputePipeline particleArgsPipeline{};
+  etna::ComputePipeline particleGridCountPipeline{};
+  etna::ComputePipeline particleGridScanPipeline{};
+  etna::ComputePipeline particleGridScatterPipeline{};
   etna::ComputePipeline particleCalculatePipeline{};
   etna::ComputePipeline particleIntegratePipeline{};
-  etna::ComputePipeline particleSpawnPipeline{};
-  etna::ComputePipeline particleSortPipeline{};
+  etna::ComputePipeline particleCullPipeline{};
 
-  void* particleSSBOMapping  = nullptr;
-  void* emitterSSBOMapping   = nullptr;
-  void* particleCountMapping = nullptr;
+  std::unique_ptr<GpuSort> sorter;
 
-  std::uint32_t const maxParticlesPerEmitter = 5'000'000;
-  const std::uint32_t max_particlesPerEmitter = Emitter().maxParticlesPerEmitter;
+  // Simulation and render streams are split, drawing only reads the compact one
+  etna::Buffer particleBuffer;
+  etna::Buffer renderParticleBuffer;
+  etna::Buffer deadListBuffer;
+  std::array<etna::Buffer, 2> aliveListBuffers;
+  etna::Buffer counterBuffer;
+  etna::Buffer statsBuffer;
+  etna::Buffer emitterStateBuffer;
+  etna::Buffer sortBuffer;
 
-public:
-  struct ParticleUBO {
-    float deltaT;
-    uint32_t particleCount;
-    glm::vec3 gravity;
-    glm::vec3 wind;
-    float drag;
-  };
-  ParticleUBO particleUbo;
+  // Spatial hash grid, rebuilt every frame with a counting sort by cell
+  etna::Buffer gridCellCountBuffer;
+  etna::Buffer gridCellStartBuffer;
+  etna::Buffer gridBlockSumBuffer;
+  etna::Buffer gridParticleCellBuffer;
+  etna::Buffer gridPositionBuffer;
 
-  struct SpawnUBO {
-    float deltaTime;
-    uint32_t emitterCount;
-  };
+  void* statsMapping = nullptr;
 
-  struct EmitterGPU {
-    glm::vec3 position;
-    float timeSinceLastSpawn;
-    glm::vec3 initialVelocity;
-    float spawnFrequency;
-    float particleLifetime;
-    float size;
-    uint32_t maxParticlesPerEmitter;
-    uint32_t currentParticles;
+  // Emitter parameters of the last few frames, a copy per frame in flight.
+  // update() runs before the frame fence is waited on, so the copy being
+  // written must not be one the GPU may still read
+  static constexpr std::uint32_t FRAME_RING = 3;
+  std::array<etna::Buffer, FRAME_RING> emitterBuffers;
+  std::array<void*, FRAME_RING> emitterMappings{};
+  std::uint32_t emitterSection = 0;
+
+  // Slots of removed emitters keep killing their particles for a few frames
+  // before they can be reused, so that frames in flight never mix them up
+  static constexpr std::uint32_t SLOT_RETIRE_FRAMES = 3;
+  struct RetiredSlot
+  {
+    std::uint32_t slot;
+    std::uint32_t framesLeft;
   };
-private:
-  void sortEmitterParticles(
-    vk::CommandBuffer cmd_buf,
-    Emitter& emitter,
-    glm::vec3 cam_pos);
-};
\ No newline at end of file
+
+  std::vector<EmitterGPU> emitterParams;
+  std::vector<std::uint32_t> freeEmitterSlots;
+  std::vector<RetiredSlot> retiredEmitterSlots;
+  std::uint32_t emitterSlotCount = 0;
+
+  // Alive list the next simulation step reads from, the other one receives survivors
+  std::uint32_t currentAliveList = 0;
+
+  bool resetPending = true;
+  float deltaTime = 0.0f;
+  glm::vec3 wind = {0.0f, 0.0f, 0.0f};
+  glm::vec3 cameraPosition = {0.0f, 0.0f, 0.0f};
+
+  std::uint32_t aliveParticleCount = 0;
+  std::uint32_t visibleParticleCount = 0;
+  // Particles spawned by the last few frames, GPU statistics do not include them yet
+  std::array<std::uint32_t, 4> recentSpawnCounts{};
+  std::uint32_t frameIndex = 0;
+  std::uint32_t sortCapacity = 0;
+};
@@ -0,0 +1,295 @@
+#include "ParticleTileRenderer.hpp"
+#include "etna/Etna.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <etna/GlobalContext.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/RenderTargetStates.hpp>
+
+#include "render_utils/Barriers.hpp"
+
+namespace
+{
+
+// Same layout as TileParams in particle_tile.glsl
+struct TileParams
+{
+  glm::mat4 viewProj;
+  glm::vec3 cameraPosition;
+  float pointScale;
+  glm::vec2 viewportSize;
+  glm::uvec2 tileCount;
+  std::uint32_t entryCapacity;
+};
+
+} // namespace
+
+void ParticleTileRenderer::setupPipelines(vk::Format target_format)
+{
+  auto& pipelineManager = etna::get_context().getPipelineManager();
+  binPipeline    = pipelineManager.createComputePipeline("particle_tile_bin",    {});
+  rangesPipeline = pipelineManager.createComputePipeline("particle_tile_ranges", {});
+  rasterPipeline = pipelineManager.createComputePipeline("particle_tile_raster", {});
+
+  compositePipeline = pipelineManager.createGraphicsPipeline(
+    "particle_tile_composite",
+    etna::GraphicsPipeline::CreateInfo{
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eNone,
+          .frontFace = vk::FrontFace::eCounterClockwise,
+          .lineWidth = 1.f,
+        },
+      .blendingConfig = {
+        .attachments = {vk::PipelineColorBlendAttachmentState{
+          .blendEnable = VK_TRUE,
+          .srcColorBlendFactor = vk::BlendFactor::eOne,
+          .dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+          .colorBlendOp = vk::BlendOp::eAdd,
+          .srcAlphaBlendFactor = vk::BlendFactor::eOne,
+          .dstAlphaBlendFactor = vk::BlendFactor::eZero,
+          .alphaBlendOp = vk::BlendOp::eAdd,
+          .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+        }},
+        .logicOpEnable = false,
+        .logicOp = vk::LogicOp::eCopy,
+      },
+      .fragmentShaderOutput =
+        {
+          .colorAttachmentFormats = {target_format},
+        },
+    });
+
+  sorter = std::make_unique<GpuSort>();
+}
+
+void ParticleTileRenderer::allocateResources(glm::uvec2 target_resolution)
+{
+  auto& ctx = etna::get_context();
+
+  resolution = target_resolution;
+  tileCount = (resolution + glm::uvec2(PARTICLE_TILE_SIZE - 1)) / glm::uvec2(PARTICLE_TILE_SIZE);
+  ETNA_VERIFYF(
+    tileCount.x * tileCount.y <= PARTICLE_TILE_MAX_TILES,
+    "{}x{} particle tiles do not fit into the tile entry keys",
+    tileCount.x,
+    tileCount.y);
+
+  sampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "particle_tile_sampler"});
+
+  resultImage = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+    .name = "particle_tile_result",
+    .format = vk::Format::eR16G16B16A16Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+  });
+
+  // Allocated for the largest capacity, only a power of two prefix is sorted
+  tileEntryBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = MAX_ENTRY_CAPACITY * sizeof(glm::uvec2),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_tile_entries",
+  });
+
+  tileRangeBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = tileCount.x * tileCount.y * sizeof(glm::uvec2),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_tile_ranges",
+  });
+
+  tileCounterBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst |
+      vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "particle_tile_counters",
+  });
+
+  statsBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t),
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .name = "particle_tile_stats",
+  });
+  statsMapping = statsBuffer.map();
+  std::memset(statsMapping, 0, sizeof(std::uint32_t));
+}
+
+void ParticleTileRenderer::rasterize(
+  vk::CommandBuffer cmd_buf,
+  const ParticleSystem& particles,
+  const ParticleView& view,
+  const etna::Image& scene_depth,
+  const etna::Buffer& uniform_params)
+{
+  // The entry count is a few frames late, like the particle statistics, so leave some headroom
+  std::memcpy(&tileEntryCount, statsMapping, sizeof(std::uint32_t));
+  entryCapacity = std::clamp(std::bit_ceil(tileEntryCount + tileEntryCount / 4), MIN_ENTRY_CAPACITY, MAX_ENTRY_CAPACITY);
+
+  const TileParams params{
+    .viewProj = view.viewProj,
+    .cameraPosition = view.cameraPosition,
+    .pointScale = view.pointScale,
+    .viewportSize = view.viewportSize,
+    .tileCount = tileCount,
+    .entryCapacity = entryCapacity,
+  };
+
+  // Unused entries keep the largest key and end up behind every tile
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eTransferRead,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite);
+  cmd_buf.fillBuffer(tileEntryBuffer.get(), 0, entryCapacity * sizeof(glm::uvec2), 0xFFFFFFFFu);
+  cmd_buf.fillBuffer(tileRangeBuffer.get(), 0, VK_WHOLE_SIZE, 0);
+  cmd_buf.fillBuffer(tileCounterBuffer.get(), 0, VK_WHOLE_SIZE, 0);
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite);
+
+  // Only as many threads as the cull could have kept, the pass itself reads the exact count
+  if (particles.getSortCapacity() > 0)
+  {
+    auto binInfo = etna::get_shader_program("particle_tile_bin");
+    auto descSet = etna::create_descriptor_set(
+      binInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, particles.getRenderParticleBuffer().genBinding()},
+        etna::Binding{1, particles.getCounterBuffer().genBinding()},
+        etna::Binding{2, particles.getSortBuffer().genBinding()},
+        etna::Binding{3, tileEntryBuffer.genBinding()},
+        etna::Binding{4, tileCounterBuffer.genBinding()},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, binPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, binPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      binPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(params), &params);
+    cmd_buf.dispatch((particles.getSortCapacity() + PARTICLE_WORKGROUP_SIZE - 1) / PARTICLE_WORKGROUP_SIZE, 1, 1);
+  }
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite,
+    vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eTransferRead);
+
+  // Requested entries, including the dropped ones, size the capacity of the next frames
+  cmd_buf.copyBuffer(tileCounterBuffer.get(), statsBuffer.get(), {vk::BufferCopy{0, 0, sizeof(std::uint32_t)}});
+
+  sorter->sort(cmd_buf, tileEntryBuffer, entryCapacity);
+  compute_barrier(cmd_buf);
+
+  {
+    auto rangesInfo = etna::get_shader_program("particle_tile_ranges");
+    auto descSet = etna::create_descriptor_set(
+      rangesInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, tileEntryBuffer.genBinding()},
+        etna::Binding{1, tileCounterBuffer.genBinding()},
+        etna::Binding{2, tileRangeBuffer.genBinding()},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, rangesPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, rangesPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      rangesPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      sizeof(entryCapacity),
+      &entryCapacity);
+    cmd_buf.dispatch(entryCapacity / PARTICLE_WORKGROUP_SIZE, 1, 1);
+    compute_barrier(cmd_buf);
+  }
+
+  etna::set_state(
+    cmd_buf,
+    scene_depth.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eDepth);
+  etna::set_state(
+    cmd_buf,
+    resultImage.get(),
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderWrite,
+    vk::ImageLayout::eGeneral,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  {
+    auto rasterInfo = etna::get_shader_program("particle_tile_raster");
+    auto descSet = etna::create_descriptor_set(
+      rasterInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, particles.getRenderParticleBuffer().genBinding()},
+        etna::Binding{1, tileEntryBuffer.genBinding()},
+        etna::Binding{2, tileRangeBuffer.genBinding()},
+        etna::Binding{3, scene_depth.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+        etna::Binding{4, resultImage.genBinding({}, vk::ImageLayout::eGeneral)},
+        etna::Binding{5, uniform_params.genBinding()},
+      });
+
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, rasterPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute, rasterPipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+    cmd_buf.pushConstants(
+      rasterPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(params), &params);
+    cmd_buf.dispatch(tileCount.x, tileCount.y, 1);
+  }
+
+  // Hand the depth back right away, otherwise the next frame's scene pass would wait
+  // for all compute work before it, including the simulation it could overlap with
+  etna::set_state(
+    cmd_buf,
+    scene_depth.get(),
+    vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
+    vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+    vk::ImageLayout::eDepthStencilAttachmentOptimal,
+    vk::ImageAspectFlagBits::eDepth);
+  etna::set_state(
+    cmd_buf,
+    resultImage.get(),
+    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
+
+void ParticleTileRenderer::composite(vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
+{
+  auto compositeInfo = etna::get_shader_program("particle_tile_composite");
+  auto descSet = etna::create_descriptor_set(
+    compositeInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, resultImage.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {resolution.x, resolution.y}},
+    {{.image = target_image, .view = target_image_view, .loadOp = vk::AttachmentLoadOp::eLoad}},
+    {});
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, compositePipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics, compositePipeline.getVkPipelineLayout(), 0, {descSet.getVkSet()}, {});
+  cmd_buf.draw(3, 1, 0, 0);
+}
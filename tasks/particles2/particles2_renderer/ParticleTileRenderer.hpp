@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/GraphicsPipeline.hpp>
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <glm/glm.hpp>
+#include "ParticleSystem.hpp"
+#include "render_utils/GpuSort.hpp"
+
+enum class ParticleRenderMode : std::uint32_t
+{
+  // Point sprites through the fixed-function blend
+  Raster       = 0,
+  // Binned into screen tiles and blended in compute
+  ComputeTiles = 1,
+};
+
+/**
+ * Alternative to the point sprite draw for scenes with heavy overdraw.
+ * Visible particles are binned into PARTICLE_TILE_SIZE screen tiles, the
+ * (tile, distance) entries are sorted, and one workgroup per tile blends its
+ * particles front to back in shared memory, stopping once every pixel is opaque.
+ * The result is composited over the frame with premultiplied alpha.
+ */
+class ParticleTileRenderer
+{
+public:
+  static constexpr std::uint32_t MIN_ENTRY_CAPACITY = 1u << 16;
+  static constexpr std::uint32_t MAX_ENTRY_CAPACITY = 1u << 22;
+
+  ParticleTileRenderer() = default;
+
+  void setupPipelines(vk::Format target_format);
+  void allocateResources(glm::uvec2 resolution);
+
+  // Expects the particles to be culled and the scene depth to be final,
+  // must be recorded outside of rendering
+  void rasterize(
+    vk::CommandBuffer cmd_buf,
+    const ParticleSystem& particles,
+    const ParticleView& view,
+    const etna::Image& scene_depth,
+    const etna::Buffer& uniform_params);
+  // Blends the tile result over the target
+  void composite(vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
+
+  std::uint32_t getTileEntryCount() const { return tileEntryCount; }
+
+private:
+  etna::ComputePipeline binPipeline{};
+  etna::ComputePipeline rangesPipeline{};
+  etna::ComputePipeline rasterPipeline{};
+  etna::GraphicsPipeline compositePipeline{};
+
+  std::unique_ptr<GpuSort> sorter;
+
+  etna::Image resultImage;
+  etna::Sampler sampler;
+
+  etna::Buffer tileEntryBuffer;
+  etna::Buffer tileRangeBuffer;
+  etna::Buffer tileCounterBuffer;
+  etna::Buffer statsBuffer;
+  void* statsMapping = nullptr;
+
+  glm::uvec2 resolution{};
+  glm::uvec2 tileCount{};
+  std::uint32_t tileEntryCount = 0;
+  std::uint32_t entryCapacity = MIN_ENTRY_CAPACITY;
+};
@@ -38,6 +38,9 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
     .physicalDeviceIndexOverride = {},
     .numFramesInFlight = 2,
   });
+
+  // etna creates a single universal queue, so the particle simulation overlaps with
+  // the scene on it instead of going to a separate compute queue
 }
 
 void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvider res_provider)
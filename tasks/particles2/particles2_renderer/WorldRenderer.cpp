@@ -14,10 +14,9 @@
 
 WorldRenderer::WorldRenderer()
   : sceneMgr{std::make_unique<SceneManager>()},
-    gui{std::make_unique<WorldRendererGui>(*this)}
+    gui{std::make_unique<WorldRendererGui>(*this)},
+    terrainRenderer{std::make_unique<TerrainRenderer>()}
 {
-  groupCountX = (terrainTextureSizeWidth + computeWorkgroupSize - 1) / computeWorkgroupSize;
-  groupCountY = (terrainTextureSizeHeight + computeWorkgroupSize - 1) / computeWorkgroupSize;
 }
 
 void WorldRenderer::allocateResources(const glm::uvec2 swapchain_resolution)
@@ -32,7 +31,8 @@ void WorldRenderer::allocateResources(const glm::uvec2 swapchain_resolution)
     .extent = vk::Extent3D{resolution.x, resolution.y, 1},
     .name = "main_view_depth",
     .format = vk::Format::eD32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+    // Sampled by the tiled particle rasterizer
+    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
   });
 
   constants = ctx.createBuffer(etna::Buffer::CreateInfo{
@@ -52,16 +52,8 @@ void WorldRenderer::allocateResources(const glm::uvec2 swapchain_resolution)
   });
   uniformMapping = uniformParamsBuffer.map();
 
-  perlinValuesBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(PerlinParams),
-    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
-    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
-    .allocationCreate = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-    .name = "perlin_values",
-  });
-  perlinValuesMapping = perlinValuesBuffer.map();
-
-  std::memcpy(perlinValuesMapping, &perlinParams, sizeof(PerlinParams));
+  particleSystem->allocateResources();
+  particleTileRenderer->allocateResources(resolution);
 
   maxInstances = 1;
   instanceMatricesBuffer = ctx.createBuffer(etna::Buffer::CreateInfo{
@@ -73,25 +65,7 @@ void WorldRenderer::allocateResources(const glm::uvec2 swapchain_resolution)
   });
   persistentMapping = instanceMatricesBuffer.map();
 
-  perlinTerrainImage = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{terrainTextureSizeWidth, terrainTextureSizeHeight, 1},
-    .name = "perlin_noise",
-    .format = vk::Format::eR32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage});
-
-  normalMapTerrainImage = ctx.createImage(etna::Image::CreateInfo{
-    .extent = vk::Extent3D{terrainTextureSizeWidth, terrainTextureSizeHeight, 1},
-    .name = "normal_map_terrain",
-    .format = vk::Format::eR32G32B32A32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage});
-
-  auto cmdManager = ctx.createOneShotCmdMgr();
-  auto cmdBuf = cmdManager->start();
-  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
-  createTerrainMap(cmdBuf);
-  ETNA_CHECK_VK_RESULT(cmdBuf.end());
-
-  cmdManager->submitAndWait(cmdBuf);
+  terrainRenderer->allocateResources(constants, uniformParamsBuffer, defaultSampler);
 }
 
 void WorldRenderer::loadScene(const std::filesystem::path& path)
@@ -125,19 +99,21 @@ void WorldRenderer::loadShaders()
     "static_mesh_material",
     {PARTICLES2_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
      PARTICLES2_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
-  etna::create_program("perlin_terrain", {PARTICLES2_RENDERER_SHADERS_ROOT "terrain_perlin.comp.spv"});
-  etna::create_program("normal_map_generation", {PARTICLES2_RENDERER_SHADERS_ROOT "terrain_normal.comp.spv"});
-  etna::create_program(
-    "terrain_render",
-    {PARTICLES2_RENDERER_SHADERS_ROOT "quad.vert.spv",
-     PARTICLES2_RENDERER_SHADERS_ROOT "terrain.tesc.spv",
-     PARTICLES2_RENDERER_SHADERS_ROOT "terrain.tese.spv",
-     PARTICLES2_RENDERER_SHADERS_ROOT "terrain.frag.spv"});
   etna::create_program("particle_render", {PARTICLES2_RENDERER_SHADERS_ROOT "particle.frag.spv", PARTICLES2_RENDERER_SHADERS_ROOT "particle.vert.spv"});
+  etna::create_program("particle_reset", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_reset.comp.spv"});
+  etna::create_program("particle_spawn", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_spawn.comp.spv"});
+  etna::create_program("particle_args", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_args.comp.spv"});
+  etna::create_program("particle_grid_count", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_grid_count.comp.spv"});
+  etna::create_program("particle_grid_scan", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_grid_scan.comp.spv"});
+  etna::create_program("particle_grid_scatter", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_grid_scatter.comp.spv"});
   etna::create_program("particle_calculate", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_calculate.comp.spv"});
   etna::create_program("particle_integrate", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_integrate.comp.spv"});
-  etna::create_program("particle_spawn", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_spawn.comp.spv"});
-  etna::create_program("particle_sort", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_sort.comp.spv"});
+  etna::create_program("particle_cull", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_cull.comp.spv"});
+  etna::create_program("particle_tile_bin", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_tile_bin.comp.spv"});
+  etna::create_program("particle_tile_ranges", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_tile_ranges.comp.spv"});
+  etna::create_program("particle_tile_raster", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_tile_raster.comp.spv"});
+  etna::create_program("particle_tile_composite", {PARTICLES2_RENDERER_SHADERS_ROOT "particle_composite.vert.spv", PARTICLES2_RENDERER_SHADERS_ROOT "particle_composite.frag.spv"});
+  terrainRenderer->loadShaders();
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
@@ -160,6 +136,11 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 
   particleSystem->setupPipelines();
 
+  particleTileRenderer = std::make_unique<ParticleTileRenderer>();
+  particleTileRenderer->setupPipelines(swapchain_format);
+
+  gpuTimer = std::make_unique<GpuTimer>(GPU_SCOPE_COUNT, GPU_TIMER_FRAMES);
+
   staticMeshPipeline = {};
   staticMeshPipeline = pipelineManager.createGraphicsPipeline(
     "static_mesh_material",
@@ -178,46 +159,9 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
           .depthAttachmentFormat = vk::Format::eD32Sfloat,
         },
     });
-  perlinPipeline            = pipelineManager.createComputePipeline("perlin_terrain", {});
-  normalPipeline            = pipelineManager.createComputePipeline("normal_map_generation", {});
-
-  terrainPipeline           = pipelineManager.createGraphicsPipeline(
-    "terrain_render",
-    etna::GraphicsPipeline::CreateInfo{
-      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePatchList},
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {swapchain_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
   particlePipeline = pipelineManager.createGraphicsPipeline(
     "particle_render",
     etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = etna::VertexShaderInputDescription{
-        .bindings = {etna::VertexShaderInputDescription::Binding{
-          .byteStreamDescription = etna::VertexByteStreamFormatDescription{
-            .stride = sizeof(ParticleGPU),
-            .attributes = {
-              etna::VertexByteStreamFormatDescription::Attribute{
-                .format = vk::Format::eR32G32B32A32Sfloat,
-                .offset = 0,
-              },
-              etna::VertexByteStreamFormatDescription::Attribute{
-                .format = vk::Format::eR32G32B32A32Sfloat,
-                .offset = 16,
-              },
-            },
-          },
-        }},
-      },
       .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePointList},
       .rasterizationConfig =
         vk::PipelineRasterizationStateCreateInfo{
@@ -246,6 +190,7 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
           .depthAttachmentFormat = vk::Format::eD32Sfloat,
         },
     });
+  terrainRenderer->setupPipelines(swapchain_format);
 }
 
 bool WorldRenderer::isVisibleBoundingBox(
@@ -321,8 +266,16 @@ void WorldRenderer::update(const FramePacket& packet)
   // calc camera matrix
   {
     const float aspect = float(resolution.x) / float(resolution.y);
-    worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+    const glm::mat4 proj = packet.mainCam.projTm(aspect);
+    worldViewProj = proj * packet.mainCam.viewTm();
     camView = packet.mainCam.position;
+
+    particleView = ParticleView{
+      .viewProj = worldViewProj,
+      .cameraPosition = camView,
+      .viewportSize = glm::vec2(resolution),
+      .pointScale = 0.5f * float(resolution.y) * std::abs(proj[1][1]),
+    };
   }
 
   std::memcpy(uniformMapping, &uniformParams, sizeof(UniformParams));
@@ -330,22 +283,17 @@ void WorldRenderer::update(const FramePacket& packet)
   float dt = packet.currentTime - previousTime;
   previousTime = packet.currentTime;
 
-  particleSystem->update(dt, wind);
+  particleSystem->update(dt, wind, camView);
 
-  currentParticleCount = 0;
-  totalParticles = 0;
-  if (!particleSystem->emitters.empty()) {
-    for (const auto& emitter : particleSystem->emitters)
-      totalParticles += emitter.currentParticleCount;
-    currentParticleCount = totalParticles;
-  }
+  currentParticleCount = particleSystem->getAliveParticleCount();
   totalParticles = currentParticleCount;
   while (totalParticles >= nextMilestone && fpsMilestones.find(nextMilestone) == fpsMilestones.end()) {
     fpsMilestones[nextMilestone] = ImGui::GetIO().Framerate;
     nextMilestone += 5000;
   }
 
-  std::memcpy(perlinValuesMapping, &perlinParams, sizeof(PerlinParams));
+  terrainRenderer->update(perlinParams);
+  terrainRenderer->selectNodes(camView, worldViewProj);
 
   WorldRendererConstants worldConstants{
     .viewProj = worldViewProj,
@@ -524,6 +472,22 @@ void WorldRenderer::renderScene(
 void WorldRenderer::renderWorld(
   vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
 {
+  gpuTimer->beginFrame(cmd_buf);
+
+  // Terrain edits are regenerated a few tiles per frame in the background.
+  // Terrain compute ends with barriers from every earlier compute stage to the draws,
+  // so it is recorded ahead of the simulation to keep those draws from waiting on it
+  terrainRenderer->updateTerrainMaps(cmd_buf);
+  if (enableTerrainRendering)
+    terrainRenderer->cullPatches(cmd_buf);
+
+  // The simulation only synchronizes with compute work, so the scene passes
+  // below can start rasterizing while it is still running
+  gpuTimer->start(cmd_buf, GPU_SCOPE_PARTICLE_SIMULATION);
+  particleSystem->simulate(cmd_buf);
+  gpuTimer->stop(cmd_buf, GPU_SCOPE_PARTICLE_SIMULATION);
+
+  gpuTimer->start(cmd_buf, GPU_SCOPE_SCENE);
   ETNA_PROFILE_GPU(cmd_buf, renderWorld)
   {
     etna::RenderTargetState renderTargets(
@@ -541,18 +505,46 @@ void WorldRenderer::renderWorld(
     if (enableTerrainRendering)
     {
       ETNA_PROFILE_GPU(cmd_buf, renderTerrain);
-      cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, terrainPipeline.getVkPipeline());
-      renderTerrain(cmd_buf);
+      terrainRenderer->render(cmd_buf);
     }
   }
+  gpuTimer->stop(cmd_buf, GPU_SCOPE_SCENE);
+
+  if (enableParticleRendering)
+    renderParticles(cmd_buf, target_image, target_image_view);
+
+  if (drawDebugTerrainQuad)
+    quadRenderer->render(cmd_buf, target_image, target_image_view, terrainRenderer->getPerlinTerrainImage(), defaultSampler);
+}
+
+void WorldRenderer::renderParticles(
+  vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view)
+{
+  const auto timerScope = static_cast<std::uint32_t>(particleRenderMode);
+  gpuTimer->start(cmd_buf, timerScope);
 
-  if (enableParticleRendering) {
-    ETNA_PROFILE_GPU(cmd_buf, sortParticles);
-    particleSystem->sortAllEmitters(cmd_buf, camView);
+  if (particleRenderMode == ParticleRenderMode::ComputeTiles)
+  {
+    {
+      ETNA_PROFILE_GPU(cmd_buf, cullParticles);
+      particleSystem->cullAndSort(cmd_buf, particleView, false);
+    }
+    {
+      ETNA_PROFILE_GPU(cmd_buf, rasterizeParticleTiles);
+      particleTileRenderer->rasterize(cmd_buf, *particleSystem, particleView, mainViewDepth, uniformParamsBuffer);
+    }
+    particleTileRenderer->composite(cmd_buf, target_image, target_image_view);
+    gpuTimer->stop(cmd_buf, timerScope);
+    return;
+  }
+
+  {
+    ETNA_PROFILE_GPU(cmd_buf, cullAndSortParticles);
+    particleSystem->cullAndSort(cmd_buf, particleView);
     etna::flush_barriers(cmd_buf);
   }
 
-  if (enableParticleRendering) {
+  {
     etna::RenderTargetState renderTargets(
       cmd_buf,
       {{0, 0}, {resolution.x, resolution.y}},
@@ -568,153 +560,28 @@ void WorldRenderer::renderWorld(
         {
           etna::Binding{0, constants.genBinding()},
           etna::Binding{1, uniformParamsBuffer.genBinding()},
+          etna::Binding{2, particleSystem->getRenderParticleBuffer().genBinding()},
+          etna::Binding{3, particleSystem->getSortBuffer().genBinding()},
         });
       cmd_buf.bindDescriptorSets(
         vk::PipelineBindPoint::eGraphics, particlePipeline.getVkPipelineLayout(), 0,
         {descSet.getVkSet()}, {});
     }
+    cmd_buf.pushConstants(
+      particlePipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eVertex,
+      0,
+      sizeof(particleView.pointScale),
+      &particleView.pointScale);
     particleSystem->render(cmd_buf);
   }
 
-  if (drawDebugTerrainQuad)
-    quadRenderer->render(cmd_buf, target_image, target_image_view, perlinTerrainImage, defaultSampler);
-}
-
-void WorldRenderer::renderTerrain(vk::CommandBuffer cmd_buf) const
-{
-  auto info = etna::get_shader_program("terrain_render");
-  auto perlinBind = perlinTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
-  auto normalBind = normalMapTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
-
-  auto descSet = etna::create_descriptor_set(
-    info.getDescriptorLayoutId(0),
-    cmd_buf,
-    {
-      etna::Binding{0, perlinBind},
-      etna::Binding{1, normalBind},
-      etna::Binding{2, constants.genBinding()},
-      etna::Binding{3, uniformParamsBuffer.genBinding()},
-    });
-  auto vkSet = descSet.getVkSet();
-  auto layout = terrainPipeline.getVkPipelineLayout();
-
-  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &vkSet, 0, nullptr);
-
-  cmd_buf.draw(4, (terrainTextureSizeWidth * terrainTextureSizeHeight) / (computeWorkgroupSize * computeWorkgroupSize * 16), 0, 0);
+  gpuTimer->stop(cmd_buf, timerScope);
 }
 
 void WorldRenderer::regenerateTerrain()
 {
-  auto& ctx = etna::get_context();
-  auto cmdManager = ctx.createOneShotCmdMgr();
-  auto cmdBuf = cmdManager->start();
-  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
-  createTerrainMap(cmdBuf);
-  ETNA_CHECK_VK_RESULT(cmdBuf.end());
-  cmdManager->submitAndWait(cmdBuf);
-}
-
-void WorldRenderer::createTerrainMap(const vk::CommandBuffer cmd_buf)
-{
-  etna::set_state(
-    cmd_buf,
-    perlinTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eComputeShader,
-    vk::AccessFlagBits2::eShaderWrite,
-    vk::ImageLayout::eGeneral,
-    vk::ImageAspectFlagBits::eColor);
-
-  etna::flush_barriers(cmd_buf);
-
-  {
-    auto perlinInfo = etna::get_shader_program("perlin_terrain");
-
-    auto binding = perlinTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eGeneral, {});
-
-    auto set = etna::create_descriptor_set(
-      perlinInfo.getDescriptorLayoutId(0),
-      cmd_buf,
-      {
-        etna::Binding{0, binding},
-        etna::Binding{1, perlinValuesBuffer.genBinding()},
-      });
-
-    const vk::DescriptorSet vkSet = set.getVkSet();
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, perlinPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eCompute,
-      perlinPipeline.getVkPipelineLayout(),
-      0,
-      1,
-      &vkSet,
-      0,
-      nullptr);
-
-    cmd_buf.dispatch(terrainTextureSizeWidth / computeWorkgroupSize, terrainTextureSizeHeight / computeWorkgroupSize, 1);
-  }
-
-  etna::set_state(
-    cmd_buf,
-    perlinTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eComputeShader,
-    vk::AccessFlagBits2::eShaderRead,
-    vk::ImageLayout::eGeneral,
-    vk::ImageAspectFlagBits::eColor);
-
-  etna::set_state(
-    cmd_buf,
-    normalMapTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eComputeShader,
-    vk::AccessFlagBits2::eShaderWrite,
-    vk::ImageLayout::eGeneral,
-    vk::ImageAspectFlagBits::eColor);
-  etna::flush_barriers(cmd_buf);
-
-  {
-    auto normalInfo = etna::get_shader_program("normal_map_generation");
-    auto binding0 = perlinTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eGeneral, {});
-    auto binding1 = normalMapTerrainImage.genBinding(defaultSampler.get(), vk::ImageLayout::eGeneral, {});
-
-    auto set = etna::create_descriptor_set(
-      normalInfo.getDescriptorLayoutId(0),
-      cmd_buf,
-      {
-        etna::Binding{0, binding0},
-        etna::Binding{1, binding1},
-      });
-
-    vk::DescriptorSet vkSet = set.getVkSet();
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, normalPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eCompute,
-      normalPipeline.getVkPipelineLayout(),
-      0,
-      1,
-      &vkSet,
-      0,
-      nullptr);
-
-    cmd_buf.dispatch(groupCountX, groupCountY, 1);
-  }
-
-  etna::set_state(
-    cmd_buf,
-    perlinTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eTessellationEvaluationShader,
-    vk::AccessFlagBits2::eShaderSampledRead,
-    vk::ImageLayout::eReadOnlyOptimal,
-    vk::ImageAspectFlagBits::eColor);
-
-  etna::set_state(
-    cmd_buf,
-    normalMapTerrainImage.get(),
-    vk::PipelineStageFlagBits2::eTessellationEvaluationShader,
-    vk::AccessFlagBits2::eShaderSampledRead,
-    vk::ImageLayout::eReadOnlyOptimal,
-    vk::ImageAspectFlagBits::eColor);
-  etna::flush_barriers(cmd_buf);
+  terrainRenderer->regenerateTerrain();
 }
 
 float WorldRenderer::getCameraSpeed() const
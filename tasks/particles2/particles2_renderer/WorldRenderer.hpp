@@ -12,10 +12,13 @@
 #include "scene/SceneManager.hpp"
 #include "wsi/Keyboard.hpp"
 #include "render_utils/QuadRenderer.hpp"
+#include "render_utils/GpuTimer.hpp"
+#include "terrain/TerrainRenderer.hpp"
 
 #include "FramePacket.hpp"
 
 #include "ParticleSystem.hpp"
+#include "ParticleTileRenderer.hpp"
 #include "WorldRendererGui.hpp"
 
 struct InstanceGroup
@@ -53,9 +56,7 @@ public:
 
 private:
   void renderScene(vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
-  void createTerrainMap(vk::CommandBuffer cmd_buf);
-  void renderTerrain(vk::CommandBuffer cmd_buf) const;
-  void reallocateTerrainResources();
+  void renderParticles(vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
   void regenerateTerrain();
 
   bool isVisibleBoundingBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& mvp) const;
@@ -64,41 +65,48 @@ private:
   std::unique_ptr<SceneManager> sceneMgr;
 
   etna::Image mainViewDepth;
-  etna::Image perlinTerrainImage;
-  etna::Image normalMapTerrainImage;
 
   etna::Buffer instanceMatricesBuffer;
   etna::Buffer constants;
   etna::Buffer uniformParamsBuffer;
-  etna::Buffer perlinValuesBuffer;
 
   void* persistentMapping = nullptr;
   void* uniformMapping = nullptr;
-  void* perlinValuesMapping = nullptr;
-  void* particleSSBOMapping = nullptr;
-  void* emitterSSBOMapping = nullptr;
-  void* particleCountMapping = nullptr;
 
   std::uint32_t maxInstances = 0;
-  std::uint32_t max_particles = 5'000'000;
 
   std::vector<InstanceGroup> instanceGroups;
   std::vector<glm::mat4> instanceMatrices;
 
   glm::mat4x4 worldViewProj;
   glm::vec3 camView;
+  ParticleView particleView{};
   float nearPlane;
   float farPlane;
 
   etna::GraphicsPipeline staticMeshPipeline{};
-  etna::ComputePipeline  perlinPipeline{};
-  etna::ComputePipeline  normalPipeline{};
-  etna::GraphicsPipeline terrainPipeline{};
   etna::GraphicsPipeline particlePipeline{};
 
   std::unique_ptr<QuadRenderer> quadRenderer;
 
+  std::unique_ptr<TerrainRenderer> terrainRenderer;
+
   std::unique_ptr<ParticleSystem> particleSystem;
+  std::unique_ptr<ParticleTileRenderer> particleTileRenderer;
+
+  // Particle render scopes come first and are indexed by ParticleRenderMode,
+  // each keeps the last time measured in that mode
+  enum GpuTimerScope : std::uint32_t
+  {
+    GPU_SCOPE_PARTICLES_RASTER        = static_cast<std::uint32_t>(ParticleRenderMode::Raster),
+    GPU_SCOPE_PARTICLES_COMPUTE_TILES = static_cast<std::uint32_t>(ParticleRenderMode::ComputeTiles),
+    GPU_SCOPE_PARTICLE_SIMULATION,
+    GPU_SCOPE_SCENE,
+    GPU_SCOPE_COUNT,
+  };
+  // The ring is longer than the frames in flight, so results are always complete
+  static constexpr std::uint32_t GPU_TIMER_FRAMES = 3;
+  std::unique_ptr<GpuTimer> gpuTimer;
 
   std::unique_ptr<WorldRendererGui> gui;
 
@@ -124,6 +132,7 @@ private:
     .amplitude           = 0.5f,
     .frequencyMultiplier = 2.0f,
     .scale               = 8.0f,
+    .time                = 0.0f,
   };
 
   etna::Sampler defaultSampler;
@@ -135,6 +144,7 @@ private:
   bool enableTerrainRendering  = true;
   bool enableSceneRendering    = true;
   bool enableParticleRendering = true;
+  ParticleRenderMode particleRenderMode = ParticleRenderMode::Raster;
 
   bool showPerformanceInfo     = true;
   bool showTerrainSettings     = true;
@@ -147,13 +157,6 @@ private:
 
   float previousTime = 0.0f;
 
-  std::uint32_t terrainTextureSizeWidth  = 4096;
-  std::uint32_t terrainTextureSizeHeight = 4096;
-  std::uint32_t computeWorkgroupSize = 32;
-  std::uint32_t patchSubdivision = 8;
-  std::uint32_t groupCountX;
-  std::uint32_t groupCountY;
-
   std::uint32_t renderedInstances = 0;
 
   std::size_t totalParticles  = 0;
@@ -65,6 +65,13 @@ void WorldRendererGui::drawPerformanceTab() const
     ImGui::GetIO().Framerate);
   ImGui::Text("Rendered Instances: %u", renderer_.renderedInstances);
   ImGui::Text("Total Particles: %u", renderer_.currentParticleCount);
+  ImGui::Text("Visible Particles: %u", renderer_.particleSystem->getVisibleParticleCount());
+  ImGui::Text(
+    "Terrain GPU Memory: %.1f MiB",
+    static_cast<float>(renderer_.terrainRenderer->getMemoryBytes()) / (1024.0f * 1024.0f));
+  const auto& timer = *renderer_.gpuTimer;
+  ImGui::Text("GPU Particle Simulation: %.3f ms", timer.milliseconds(WorldRenderer::GPU_SCOPE_PARTICLE_SIMULATION));
+  ImGui::Text("GPU Scene: %.3f ms", timer.milliseconds(WorldRenderer::GPU_SCOPE_SCENE));
   ImGui::Checkbox("Show FPS Milestones", &renderer_.showFpsMilestones);
   if (renderer_.showFpsMilestones)
   {
@@ -106,14 +113,20 @@ void WorldRendererGui::drawTerrainTab()
   ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
   renderer_.uniformParams.lightPos = {pos[0], pos[1], pos[2]};
 
-  ImGui::InputInt("Terrain Texture Width", reinterpret_cast<int*>(&renderer_.terrainTextureSizeWidth));
-  ImGui::InputInt("Terrain Texture Height", reinterpret_cast<int*>(&renderer_.terrainTextureSizeHeight));
-  ImGui::InputInt("Compute Workgroup Size", reinterpret_cast<int*>(&renderer_.computeWorkgroupSize));
-  ImGui::InputInt("Patch Subdivision", reinterpret_cast<int*>(&renderer_.patchSubdivision));
-  renderer_.groupCountX = (renderer_.terrainTextureSizeWidth + renderer_.computeWorkgroupSize - 1) / renderer_.computeWorkgroupSize;
-  renderer_.groupCountY = (renderer_.terrainTextureSizeHeight + renderer_.computeWorkgroupSize - 1) / renderer_.computeWorkgroupSize;
-  ImGui::Text("Group Count X: %u", renderer_.groupCountX);
-  ImGui::Text("Group Count Y: %u", renderer_.groupCountY);
+  // Every size change recreates and regenerates the maps, so sizes only apply on Enter
+  int width = static_cast<int>(renderer_.terrainRenderer->getTerrainTextureSizeWidth());
+  if (ImGui::InputInt("Terrain Texture Width", &width, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue))
+    renderer_.terrainRenderer->setTerrainTextureSizeWidth(static_cast<std::uint32_t>(std::max(width, 1)));
+
+  int height = static_cast<int>(renderer_.terrainRenderer->getTerrainTextureSizeHeight());
+  if (ImGui::InputInt("Terrain Texture Height", &height, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue))
+    renderer_.terrainRenderer->setTerrainTextureSizeHeight(static_cast<std::uint32_t>(std::max(height, 1)));
+
+  const char* renderModes[] = {"Tessellation", "CDLOD", "Streamed CDLOD"};
+  int renderMode = static_cast<int>(renderer_.terrainRenderer->getRenderMode());
+  if (ImGui::Combo("Terrain Render Mode", &renderMode, renderModes, IM_ARRAYSIZE(renderModes)))
+    renderer_.terrainRenderer->setRenderMode(static_cast<TerrainRenderMode>(renderMode));
+
   ImGui::Separator();
 
   ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Perlin Noise Parameters");
@@ -124,6 +137,8 @@ void WorldRendererGui::drawTerrainTab()
 
   if (ImGui::Button("Regenerate Terrain"))
     renderer_.regenerateTerrain();
+  if (renderer_.terrainRenderer->isRegenerating())
+    ImGui::ProgressBar(renderer_.terrainRenderer->getRegenerationProgress(), ImVec2(-1.0f, 0.0f), "Regenerating");
 }
 
 void WorldRendererGui::drawParticlesTab()
@@ -134,8 +149,42 @@ void WorldRendererGui::drawParticlesTab()
     "Particle Color", particleColor, ImGuiColorEditFlags_PickerHueWheel | ImGuiColorEditFlags_NoInputs);
   renderer_.uniformParams.particleColor = {particleColor[0], particleColor[1], particleColor[2]};
   ImGui::SliderFloat3("Wind", &renderer_.wind.x, -5.0f, 5.0f);
+
+  auto& interaction = renderer_.particleSystem->interaction;
+  int interactionMode = static_cast<int>(interaction.mode);
+  const char* interactionItems[] = { "None", "All Pairs (O(N^2))", "Spatial Hash" };
+  if (ImGui::Combo("Particle Interaction", &interactionMode, interactionItems, IM_ARRAYSIZE(interactionItems)))
+    interaction.mode = static_cast<ParticleInteraction>(interactionMode);
+  ImGui::SliderFloat("Interaction Strength", &interaction.strength, -5.0f, 5.0f);
+  if (interaction.mode == ParticleInteraction::SpatialHash)
+  {
+    ImGui::SliderFloat("Interaction Radius", &interaction.radius, 0.05f, 5.0f);
+    ImGui::SliderInt("Max Neighbours", reinterpret_cast<int*>(&interaction.maxNeighbours), 1, 256);
+  }
+  ImGui::Checkbox("Thin Out Sub-Pixel Particles", &renderer_.particleSystem->lod.enable);
+  if (renderer_.particleSystem->lod.enable)
+    ImGui::SliderFloat("Min Keep Probability", &renderer_.particleSystem->lod.minKeepProbability, 0.01f, 1.0f);
+
+  int renderMode = static_cast<int>(renderer_.particleRenderMode);
+  const char* renderModeItems[] = { "Raster (Point Sprites)", "Compute Tiles" };
+  if (ImGui::Combo("Particle Render Mode", &renderMode, renderModeItems, IM_ARRAYSIZE(renderModeItems)))
+    renderer_.particleRenderMode = static_cast<ParticleRenderMode>(renderMode);
+  // Each mode keeps its last measurement, switch between them to compare
+  const float rasterMs = renderer_.gpuTimer->milliseconds(WorldRenderer::GPU_SCOPE_PARTICLES_RASTER);
+  const float tilesMs = renderer_.gpuTimer->milliseconds(WorldRenderer::GPU_SCOPE_PARTICLES_COMPUTE_TILES);
+  ImGui::Text("GPU Particle Time, Raster: %.3f ms", rasterMs);
+  ImGui::Text("GPU Particle Time, Compute Tiles: %.3f ms", tilesMs);
+  if (rasterMs > 0.0f && tilesMs > 0.0f)
+    ImGui::Text("Compute Tiles Speedup: %.2fx", rasterMs / tilesMs);
+  if (renderer_.particleRenderMode == ParticleRenderMode::ComputeTiles)
+    ImGui::Text("Tile Entries: %u", renderer_.particleTileRenderer->getTileEntryCount());
+  ImGui::Separator();
   // ImGui::SliderInt("Max Particles per Emitter", reinterpret_cast<int*>(&renderer_.particleSystem->max_particlesPerEmitter), 0, 10000);
 
+  static int burstSize = 10'000;
+  ImGui::InputInt("Burst Size", &burstSize, 1000, 100'000);
+  burstSize = std::max(burstSize, 1);
+
   static int numEmitters = 10;
   ImGui::InputInt("Number of Emitters to Add", &numEmitters, 5, 25);
   numEmitters = std::max(numEmitters, 1);
@@ -165,6 +214,7 @@ void WorldRendererGui::drawParticlesTab()
       e.gravity = {0, -9.8f, 0};
       e.drag = 0.1f;
       e.size = 5.0f;
+      e.velocitySpread = 0.1f;
       renderer_.particleSystem->addEmitter(std::move(e));
     }
   }
@@ -189,13 +239,18 @@ void WorldRendererGui::drawParticlesTab()
     ImGui::SliderFloat3("Gravity", &emitter.gravity.x, -2, 2);
     ImGui::SliderFloat("Drag", &emitter.drag, 0.0f, 1.0f);
     ImGui::SliderFloat("Size", &emitter.size, 1.0f, 50.0f);
+    ImGui::ColorEdit4("Color", &emitter.color.x, ImGuiColorEditFlags_NoInputs);
+    ImGui::SliderFloat("Velocity Spread", &emitter.velocitySpread, 0.0f, 1.0f);
+    if (ImGui::Button("Burst"))
+      emitter.burst(static_cast<std::uint32_t>(burstSize));
+    ImGui::SameLine();
     if (ImGui::Button("Clear Particles"))
       emitter.clearParticles();
     ImGui::SameLine();
     if (ImGui::Button("Remove Emitter"))
       emittersToRemove.push_back(i);
     ImGui::SameLine();
-    ImGui::Text("Particles: %zu", emitter.particles.size());
+    ImGui::Text("Slot: %u", emitter.gpuSlot);
     ImGui::PopID();
     i++;
   }
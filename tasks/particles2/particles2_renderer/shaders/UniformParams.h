@@ -2,21 +2,114 @@
 #define UNIFORM_PARAMS_H_INCLUDED
 
 #include "cpp_glsl_compat.h"
+#include "terrain_params.h"
 
-struct PerlinParams
+#define PARTICLE_WORKGROUP_SIZE 256
+// Spawn runs one workgroup per emitter
+#define PARTICLE_SPAWN_WORKGROUP_SIZE 64
+
+#define EMITTER_FLAG_ACTIVE 1u // emitter spawns new particles
+#define EMITTER_FLAG_FRESH  2u // slot was just (re)assigned, spawn accumulator must be reset
+#define EMITTER_FLAG_KILL   4u // all particles of this emitter die on the next simulation step
+
+#define PARTICLE_ARGS_PASS_SIMULATE 0u // sizes the simulation over the alive list after spawning
+#define PARTICLE_ARGS_PASS_PUBLISH  1u // publishes the compacted alive list and sizes the cull over it
+#define PARTICLE_ARGS_PASS_DRAW     2u // sizes the draw over the visible particles
+
+// Particle sizes are given in centimeters, points are scaled with distance
+#define PARTICLE_SIZE_SCALE     0.01
+#define PARTICLE_MAX_POINT_SIZE 64.0
+
+// Sort payload of a visible particle: pool index in the low bits,
+// alpha scale of a thinned out sub-pixel particle in the high 8 bits
+#define PARTICLE_INDEX_BITS 24
+#define PARTICLE_INDEX_MASK ((1u << PARTICLE_INDEX_BITS) - 1u)
+
+// Tiled compute rasterizer: sprites are binned into square screen tiles, a tile entry
+// key holds the tile index in the high bits and the coarse view distance in the low ones
+#define PARTICLE_TILE_SIZE          16
+#define PARTICLE_TILE_DEPTH_BITS    16
+#define PARTICLE_TILE_MAX_TILES     ((1u << (32 - PARTICLE_TILE_DEPTH_BITS)) - 1u) // all ones marks unused entries
+#define PARTICLE_TILE_OPAQUE_ALPHA  0.995 // pixels past this coverage stop blending
+
+#define PARTICLE_INTERACTION_NONE         0u
+#define PARTICLE_INTERACTION_ALL_PAIRS    1u // O(N^2), every particle attracts every other one
+#define PARTICLE_INTERACTION_SPATIAL_HASH 2u // short-range forces from the 27 neighbouring grid cells
+
+// Uniform grid cells are hashed into a fixed table, the table is prefix-summed
+// in blocks of PARTICLE_GRID_SCAN_BLOCK cells, so one workgroup scans all block sums
+#define PARTICLE_GRID_HASH_SIZE  (1u << 18)
+#define PARTICLE_GRID_SCAN_BLOCK 1024u
+
+#define PARTICLE_GRID_SCAN_PASS_BLOCKS     0u // exclusive scan inside every block, writes block sums
+#define PARTICLE_GRID_SCAN_PASS_BLOCK_SUMS 1u // exclusive scan of the block sums
+#define PARTICLE_GRID_SCAN_PASS_ADD        2u // adds block offsets to the cell starts
+
+// Simulation stream, only touched by the compute passes.
+// Velocity is stored as half floats, position and lifetime stay 32-bit
+// since they accumulate small per-frame increments.
+struct ParticleGPU
 {
-  shader_uint octaves;
-  shader_float amplitude;
-  shader_float frequencyMultiplier;
-  shader_float scale;
+  shader_float positionX;
+  shader_float positionY;
+  shader_float positionZ;
+  shader_float lifetime;         // remaining lifetime, dead if <= 0
+  shader_uint  velocityXY;       // packHalf2x16
+  shader_uint  velocityZEmitter; // low 16 bits - half float velocity z, high 16 bits - emitter slot
 };
 
-struct ParticleGPU
+// Render stream written by the integrate pass, the only particle data the vertex shader reads
+struct ParticleRenderGPU
 {
-  shader_vec4 pos;
-  shader_vec4 vel;
+  shader_uint positionXY;    // packHalf2x16, relative to the camera
+  shader_uint positionZSize; // packHalf2x16, z relative to the camera and point size
+  shader_uint color;         // packUnorm4x8
+};
+
+struct EmitterGPU
+{
+  shader_vec3 position;
+  shader_float spawnFrequency;
+  shader_vec3 initialVelocity;
+  shader_float particleLifetime;
+  shader_vec3 gravity;
+  shader_float drag;
+  shader_float size;
+  shader_uint flags;
+  shader_uint color;      // packUnorm4x8
+  shader_uint burstCount; // particles spawned at once on top of the regular rate, one-shot
+  shader_float velocitySpread; // random velocity added to initialVelocity, fraction of its length
+  shader_uint pad0;
+  shader_uint pad1;
+  shader_uint pad2;
+};
+
+// Shared between all emitters, lives in a single GPU buffer which
+// is also used as the source of indirect dispatch and draw arguments.
+// Live particles are referenced by a pair of alive index lists: the simulation
+// reads one of them and appends survivors to the other one, dead slots go back
+// to the dead list, so only live particles are ever simulated, sorted and drawn.
+struct ParticleCounters
+{
+  shader_uint deadCount;
+  shader_uint aliveCount;
+  shader_uint aliveCountAfterSimulation;
+  shader_uint visibleCount;
+
+  // VkDispatchIndirectCommand for the simulation passes
+  shader_uint simulateGroupsX;
+  shader_uint simulateGroupsY;
+  shader_uint simulateGroupsZ;
+  shader_uint pad1;
+
+  // VkDrawIndirectCommand for the particle draw
+  shader_uint vertexCount;
+  shader_uint instanceCount;
+  shader_uint firstVertex;
+  shader_uint firstInstance;
 };
 
+// Starts with the members of TerrainAppParams, the terrain shaders read the same buffer
 struct UniformParams
 {
   shader_mat4 lightMatrix;
@@ -27,4 +120,4 @@ struct UniformParams
   shader_vec3 particleColor;
 };
 
-#endif // UNIFORM_PARAMS_H_INCLUDED
\ No newline at end of file
+#endif // UNIFORM_PARAMS_H_INCLUDED
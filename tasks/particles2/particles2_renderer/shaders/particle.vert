@@ -1,19 +1,46 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) in vec4 pos;
-layout(location = 1) in vec4 vel;
+#include "UniformParams.h"
+#include "particle_pack.glsl"
 
 layout(std140, set = 0, binding = 0) uniform Constants
 {
   mat4 viewProj;
+  vec4 camView;
 } constants;
 
-layout(location = 0) out vec4 vel_out;
+layout(std430, set = 0, binding = 2) readonly buffer RenderParticles
+{
+  ParticleRenderGPU renderParticles[];
+};
+
+// x - sort key, y - draw payload, sorted back to front
+layout(std430, set = 0, binding = 3) readonly buffer SortKeys
+{
+  uvec2 sortKeys[];
+};
+
+layout(push_constant) uniform PushConstants
+{
+  float pointScale;
+} pc;
+
+layout(location = 0) out vec4 color_out;
 
 void main()
 {
-  gl_Position = constants.viewProj * vec4(pos.xyz, 1.0);
-  gl_PointSize = 5.0;
-  vel_out = vel;
-}
\ No newline at end of file
+  // Only visible particles are drawn, the vertex count comes from the cull pass
+  uint payload = sortKeys[gl_VertexIndex].y;
+  ParticleRenderGPU particle = renderParticles[draw_payload_index(payload)];
+
+  vec3 position = render_particle_position(particle) + constants.camView.xyz;
+  gl_Position = constants.viewProj * vec4(position, 1.0);
+
+  float pixelSize = particle_pixel_size(render_particle_size(particle), gl_Position.w, pc.pointScale);
+  gl_PointSize = clamp(pixelSize, 1.0, PARTICLE_MAX_POINT_SIZE);
+
+  color_out = unpackUnorm4x8(particle.color);
+  color_out.a *= draw_payload_alpha(payload);
+}
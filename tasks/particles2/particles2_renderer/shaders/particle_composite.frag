@@ -0,0 +1,12 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform sampler2D particleImage;
+
+layout(location = 0) out vec4 out_fragColor;
+
+// Premultiplied, blended with (ONE, ONE_MINUS_SRC_ALPHA)
+void main()
+{
+  out_fragColor = texelFetch(particleImage, ivec2(gl_FragCoord.xy), 0);
+}
@@ -0,0 +1,18 @@
+#ifndef PARTICLE_GRID_GLSL_INCLUDED
+#define PARTICLE_GRID_GLSL_INCLUDED
+
+#include "UniformParams.h"
+
+ivec3 grid_cell(vec3 position, float cell_size)
+{
+  return ivec3(floor(position / cell_size));
+}
+
+// Infinite grid folded into a fixed size table, colliding cells simply share a bucket
+uint grid_hash(ivec3 cell)
+{
+  const uvec3 c = uvec3(cell);
+  return ((c.x * 73856093u) ^ (c.y * 19349663u) ^ (c.z * 83492791u)) & (PARTICLE_GRID_HASH_SIZE - 1u);
+}
+
+#endif // PARTICLE_GRID_GLSL_INCLUDED
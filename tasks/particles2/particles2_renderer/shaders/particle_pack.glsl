@@ -0,0 +1,70 @@
+#ifndef PARTICLE_PACK_GLSL_INCLUDED
+#define PARTICLE_PACK_GLSL_INCLUDED
+
+#include "UniformParams.h"
+
+vec3 particle_position(ParticleGPU particle)
+{
+  return vec3(particle.positionX, particle.positionY, particle.positionZ);
+}
+
+vec3 particle_velocity(ParticleGPU particle)
+{
+  return vec3(unpackHalf2x16(particle.velocityXY), unpackHalf2x16(particle.velocityZEmitter).x);
+}
+
+uint particle_emitter(ParticleGPU particle)
+{
+  return particle.velocityZEmitter >> 16;
+}
+
+void particle_set_position(inout ParticleGPU particle, vec3 position)
+{
+  particle.positionX = position.x;
+  particle.positionY = position.y;
+  particle.positionZ = position.z;
+}
+
+void particle_set_velocity(inout ParticleGPU particle, vec3 velocity)
+{
+  particle.velocityXY = packHalf2x16(velocity.xy);
+  particle.velocityZEmitter = (particle.velocityZEmitter & 0xFFFF0000u) | (packHalf2x16(vec2(velocity.z, 0.0)) & 0xFFFFu);
+}
+
+void particle_set_emitter(inout ParticleGPU particle, uint emitter)
+{
+  particle.velocityZEmitter = (particle.velocityZEmitter & 0xFFFFu) | (emitter << 16);
+}
+
+vec3 render_particle_position(ParticleRenderGPU particle)
+{
+  return vec3(unpackHalf2x16(particle.positionXY), unpackHalf2x16(particle.positionZSize).x);
+}
+
+float render_particle_size(ParticleRenderGPU particle)
+{
+  return unpackHalf2x16(particle.positionZSize).y;
+}
+
+// point_scale is half the viewport height times the vertical focal length
+float particle_pixel_size(float size, float clip_w, float point_scale)
+{
+  return size * PARTICLE_SIZE_SCALE * point_scale / clip_w;
+}
+
+uint pack_draw_payload(uint index, float alpha_scale)
+{
+  return index | (uint(clamp(alpha_scale, 0.0, 1.0) * 255.0 + 0.5) << PARTICLE_INDEX_BITS);
+}
+
+uint draw_payload_index(uint payload)
+{
+  return payload & PARTICLE_INDEX_MASK;
+}
+
+float draw_payload_alpha(uint payload)
+{
+  return float(payload >> PARTICLE_INDEX_BITS) / 255.0;
+}
+
+#endif // PARTICLE_PACK_GLSL_INCLUDED
@@ -0,0 +1,42 @@
+#ifndef PARTICLE_TILE_GLSL_INCLUDED
+#define PARTICLE_TILE_GLSL_INCLUDED
+
+#include "UniformParams.h"
+#include "particle_pack.glsl"
+
+// Shared by the binning and the raster passes, so both agree on the sprite footprint
+struct TileParams
+{
+  mat4 viewProj;
+  vec3 cameraPosition;
+  float pointScale;
+  vec2 viewportSize;
+  uvec2 tileCount;
+  uint entryCapacity;
+};
+
+struct TileSprite
+{
+  vec2 pixelMin;
+  vec2 pixelMax;
+  float depth;
+};
+
+// Same footprint as a point sprite of the raster path: a square of the clamped
+// point size around the projected center, in framebuffer pixels
+bool tile_sprite(ParticleRenderGPU particle, TileParams params, out TileSprite sprite)
+{
+  vec4 clip = params.viewProj * vec4(render_particle_position(particle) + params.cameraPosition, 1.0);
+  if (clip.w <= 0.0)
+    return false;
+
+  float pixelSize = clamp(particle_pixel_size(render_particle_size(particle), clip.w, params.pointScale), 1.0, PARTICLE_MAX_POINT_SIZE);
+  vec2 center = (clip.xy / clip.w * 0.5 + 0.5) * params.viewportSize;
+
+  sprite.pixelMin = center - 0.5 * pixelSize;
+  sprite.pixelMax = center + 0.5 * pixelSize;
+  sprite.depth = clip.z / clip.w;
+  return true;
+}
+
+#endif // PARTICLE_TILE_GLSL_INCLUDED
@@ -10,6 +10,7 @@
 
 #include "scene/SceneManager.hpp"
 #include "wsi/Keyboard.hpp"
+#include "terrain/TerrainRenderer.hpp"
 
 #include "FramePacket.hpp"
 
@@ -40,19 +41,18 @@ public:
 private:
   void renderScene(
     vk::CommandBuffer cmd_buf, vk::PipelineLayout pipeline_layout);
-  void createTerrainMap(vk::CommandBuffer cmd_buf);
-  void renderTerrain(vk::CommandBuffer cmd_buf);
 
   bool isVisibleBoundingBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& mvp) const;
 
 private:
   std::unique_ptr<SceneManager> sceneMgr;
+  std::unique_ptr<TerrainRenderer> terrainRenderer;
 
   etna::Image mainViewDepth;
-  etna::Image perlinTerrainImage;
-  etna::Image normalMapTerrainImage;
   etna::Buffer instanceMatricesBuffer;
   etna::Buffer constants;
+  // Only read by the terrain shaders, this sample has no other uniform params
+  etna::Buffer terrainParamsBuffer;
 
   void* persistentMapping = nullptr;
   uint32_t maxInstances = 0;
@@ -66,9 +66,6 @@ private:
   float farPlane;
 
   etna::GraphicsPipeline staticMeshPipeline{};
-  etna::ComputePipeline perlinPipeline{};
-  etna::ComputePipeline normalPipeline{};
-  etna::GraphicsPipeline terrainPipeline{};
 
   struct WorldRendererConstants
   {
@@ -77,18 +74,25 @@ private:
     int enableTessellation;
   };
 
+  TerrainAppParams terrainParams{
+    .lightMatrix = {},
+    .lightPos = {},
+    .time = 0.0f,
+    .baseColor = {0.4f, 0.8f, 0.2f},
+  };
+
+  PerlinParams perlinParams{
+    .octaves = 10u,
+    .amplitude = 0.5f,
+    .frequencyMultiplier = 2.0f,
+    .scale = 8.0f,
+    .time = 0.0f,
+  };
+
   etna::Sampler defaultSampler;
 
   glm::uvec2 resolution;
 
   bool enableFrustumCulling = false;
   bool enableTessellation = true;
-  static constexpr std::uint32_t TERRAIN_TEXTURE_SIZE_WIDTH  = 4096;
-  static constexpr std::uint32_t TERRAIN_TEXTURE_SIZE_HEIGHT = 4096;
-  static constexpr std::uint32_t COMPUTE_WORKGROUP_SIZE = 32;
-  static constexpr std::uint32_t PATCH_SUBDIVISION = 8;
-  static constexpr std::uint32_t GROUP_COUNT_X =
-    (TERRAIN_TEXTURE_SIZE_WIDTH + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE;
-  static constexpr std::uint32_t GROUP_COUNT_Y =
-    (TERRAIN_TEXTURE_SIZE_HEIGHT + COMPUTE_WORKGROUP_SIZE - 1) / COMPUTE_WORKGROUP_SIZE;
 };
\ No newline at end of file